@@ -289,6 +289,16 @@ uint32_t Random::poisson(uint32_t exp_prob)
     return res;
 }
 
+uint32_t Random::poisson_nonzero(uint32_t exp_prob)
+{
+    uint32_t val = exp_prob + 1 + uniform(~exp_prob), res = 0;  // first value is above exp_prob
+    while(val > exp_prob)
+    {
+        val = mul_high(val, uint32());  res++;
+    }
+    return res;
+}
+
 uint32_t Random::geometric(uint32_t prob)
 {
     uint32_t val = uint32();
@@ -78,7 +78,7 @@ inline int ilog2(uint32_t val)
 
 inline int ilog2(uint64_t val)
 {
-    return ilog2_<uint64_t, 32>(val);
+    return ilog2_<uint64_t, 64>(val);
 }
 
 #endif
@@ -115,5 +115,6 @@ public:
     uint32_t uint32();
     uint32_t uniform(uint32_t lim);
     uint32_t poisson(uint32_t exp_prob);
+    uint32_t poisson_nonzero(uint32_t exp_prob);  // conditioned on nonzero result, exp_prob < 2^32 - 1
     uint32_t geometric(uint32_t prob);
 };
@@ -11,12 +11,13 @@
 
 
 
-void print_checksum(const World &world, const OutStream &stream)
+void print_checksum(const World &world, const void *root)
 {
-    const uint32_t *checksum = static_cast<const uint32_t *>(stream.checksum());
-    std::printf("Time: %llu, Checksum:", (unsigned long long)world.current_time);
+    // root hash of restart chunks (Evol0005), not comparable with checksums of Evol0004 streams
+    const uint32_t *hash = static_cast<const uint32_t *>(root);
+    std::printf("Time: %llu, Root hash:", (unsigned long long)world.current_time);
     for(unsigned i = 0; i < Hash::result_size / 4; i++)
-        std::printf(" %08lX", (unsigned long)bswap32(checksum[i]));
+        std::printf(" %08lX", (unsigned long)bswap32(hash[i]));
     std::printf("\n");
 }
 
@@ -755,9 +756,8 @@ void Representation::update(SDL_Window *window, bool checksum, bool draw)
 
     if(checksum || !(world.current_time % 1000))
     {
-        OutStream stream;  stream.initialize();
-        stream << world;  stream.finalize();
-        print_checksum(world, stream);
+        char root[Hash::result_size];  world.checksum(root);
+        print_checksum(world, root);
     }
 
     if(!draw)return;
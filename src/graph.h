@@ -11,7 +11,7 @@
 #include "resources.h"
 
 
-void print_checksum(const World &world, const OutStream &stream);
+void print_checksum(const World &world, const void *root);
 
 
 
@@ -2,6 +2,7 @@
 //
 
 #include "hash.h"
+#include <cassert>
 #include <cstring>
 #include <cstdio>
 #include <ctime>
@@ -89,6 +90,26 @@ void Hash::process_last(void *buf, unsigned size)
     for(int i = 0; i < 8; i++)h[i] = to_le64(h[i]);
 }
 
+void Hash::process_span(const void *data, size_t size, bool last)
+{
+    // blocks are copied, so the input can be read-only memory
+    assert(last || !(size % block_size));
+
+    uint64_t m[16];
+    const char *ptr = static_cast<const char *>(data);
+    for(; size > block_size || (!last && size); ptr += block_size, size -= block_size)
+    {
+        std::memcpy(m, ptr, block_size);  process_block(m);
+    }
+    if(!last)return;
+    std::memcpy(m, ptr, size);  process_last(m, size);
+}
+
+void Hash::process(const void *data, size_t size)
+{
+    init();  process_span(data, size, true);
+}
+
 
 
 #if 1
@@ -67,6 +67,8 @@ public:
     void init();
     void process_block(void *buf);
     void process_last(void *buf, unsigned size);
+    void process_span(const void *data, size_t size, bool last);  // input is left intact
+    void process(const void *data, size_t size);  // whole message
 
     const void *result() const
     {
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <limits.h>
+#include <cstring>
 #include "glext_loader.h"
 #include "graph.h"
 #include "stream.h"
@@ -35,13 +36,22 @@ bool check_gl_error()
 
 bool load_restart(World &world, const char *path)
 {
-    InFileStream stream;
-    if(!stream.open(path))
+    ChunkFile file;
+    if(!file.open(path))
     {
         std::printf("Cannot open restart file \"%s\"!\n", path);  return false;
     }
-    stream >> world;
-    if(!stream.close())
+    bool chunked = World::chunked(file);
+    bool res = chunked && world.load(file);  file.close();
+    if(!chunked)
+    {
+        InMapStream stream(true);  // earlier version is sequential, written in frames
+        if(stream.open(path))
+        {
+            stream >> world;  res = stream.close();
+        }
+    }
+    if(!res)
     {
         std::printf("Invalid restart file \"%s\"!\n", path);  return false;
     }
@@ -50,32 +60,35 @@ bool load_restart(World &world, const char *path)
 
 bool save_restart(World &world)
 {
-    OutFileStream stream;
-    if(stream.open("default.save~"))
+    ChunkFile file;
+    if(file.create("default.save~"))
     {
-        stream << world;
-        if(stream.close() && !std::rename("default.save~", "default.save"))
+        char root[Hash::result_size];  bool res = world.save(file, root);
+        if(file.close() && res && !std::rename("default.save~", "default.save"))
         {
             std::printf("Restart successfully saved.\n");
-            print_checksum(world, stream);  return true;
+            print_checksum(world, root);  return true;
         }
     }
     std::printf("Cannot save restart!\n");  return false;
 }
 
-bool main_loop(SDL_Window *window, char **args, int n)
+const uint32_t headless_steps = 100;  // divides checksum interval
+const uint32_t max_workers = 64;
+
+bool main_loop(SDL_Window *window, const char *restart)
 {
     glEnable(GL_FRAMEBUFFER_SRGB);  glEnable(GL_MULTISAMPLE);
     glEnable(GL_CULL_FACE);
 
     World world(8);
-    if(n <= 1)
+    world.start();  // workers are used for initialization too
+    if(!restart)
         world.init();
-    else if(!load_restart(world, args[1]))
+    else if(!load_restart(world, restart))
         return false;
     Representation graph(world, window);
 
-    world.start();
     graph.update(window, true, true);
 
     if(!check_gl_error())return false;
@@ -88,7 +101,9 @@ bool main_loop(SDL_Window *window, char **args, int n)
         {
             if(play)
             {
-                world.next_step();  graph.update(window, false, active);
+                if(active)world.next_step();  // fast forward while minimized
+                else world.run_steps(headless_steps - world.current_time % headless_steps);
+                graph.update(window, false, active);
             }
             if(active)
             {
@@ -148,6 +163,20 @@ bool main_loop(SDL_Window *window, char **args, int n)
             case SDLK_F5:
                 save_restart(world);  break;
 
+            case SDLK_KP_PLUS:
+            case SDLK_KP_MINUS:
+                if(evt.key.keysym.sym == SDLK_KP_PLUS ? world.group_count < max_workers : world.group_count > 1)
+                {
+                    world.set_worker_count(world.group_count + (evt.key.keysym.sym == SDLK_KP_PLUS ? 1 : -1));
+                    std::printf("Worker count: %u\n", world.group_count);
+                }
+                continue;
+
+            case SDLK_KP_MULTIPLY:
+                world.set_ordering(world.layout.ordering == TileLayout::l_rows ? TileLayout::l_morton : TileLayout::l_rows);
+                std::printf("Tile order: %s\n", world.layout.ordering == TileLayout::l_rows ? "rows" : "Z-curve");
+                continue;
+
             default:
                 continue;
             }
@@ -168,7 +197,7 @@ bool sdl_error(const char *text)
     std::printf("%s%s\n", text, SDL_GetError());  return false;
 }
 
-int init(char **args, int n)
+int init(const char *restart)
 {
     if(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3) || SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3))
         return sdl_error("Failed to set OpenGL version: ");
@@ -209,14 +238,51 @@ int init(char **args, int n)
     if( !init_ogl_exts( ) )
         return sdl_error( "Can't load OpenGL extensions" );
 
-    bool res = main_loop(window, args, n);
+    bool res = main_loop(window, restart);
     SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);
     return res;
 }
 
+bool parse_option(const char *arg)
+{
+    static const char *kernels[] = {"scalar", "sse41", "avx2"};
+    static const char *modes[] = {"full", "incremental", "jit"};
+
+    if(!std::strcmp(arg, "--batch"))
+    {
+        Network::enable_batching(true);  return true;
+    }
+    if(!std::strncmp(arg, "--kernel=", 9))
+    {
+        for(int i = 0; i < 3; i++)
+            if(!std::strcmp(arg + 9, kernels[i]))
+            {
+                if(Network::select_kernel(Network::Kernel(i)))return true;
+                std::printf("Kernel \"%s\" is not supported!\n", arg + 9);  return false;
+            }
+    }
+    else if(!std::strncmp(arg, "--mode=", 7))
+    {
+        for(int i = 0; i < 3; i++)
+            if(!std::strcmp(arg + 7, modes[i]))
+            {
+                if(Network::select_mode(Network::Mode(i)))return true;
+                std::printf("Mode \"%s\" is not supported!\n", arg + 7);  return false;
+            }
+    }
+    std::printf("Unknown option \"%s\"!\n"
+        "Usage: Evolution [--kernel=scalar|sse41|avx2] [--mode=full|incremental|jit] [--batch] [restart]\n", arg);
+    return false;
+}
+
 int main(int n, char **args)
 {
+    const char *restart = nullptr;
+    for(int i = 1; i < n; i++)
+        if(args[i][0] != '-')restart = args[i];
+        else if(!parse_option(args[i]))return -1;
+
     if(SDL_Init(SDL_INIT_VIDEO))return sdl_error("SDL_Init failed: ");
-    bool res = init(args, n);  SDL_Quit();  return res ? 0 : -1;
+    bool res = init(restart);  SDL_Quit();  return res ? 0 : -1;
 }
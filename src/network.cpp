@@ -0,0 +1,577 @@
+// network.cpp : neural network evaluation
+//
+
+#include "network.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NETWORK_SIMD
+#define TARGET(name) __attribute__((target(name)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define NETWORK_SIMD
+#define TARGET(name)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__) && defined(__x86_64__)
+#define NETWORK_JIT
+#include <sys/mman.h>
+#endif
+
+
+
+// Network struct
+
+void Network::build(const std::vector<int32_t> &levels, uint32_t input_count, const std::vector<Link> &links)
+{
+    neiron_count = levels.size();  this->input_count = input_count;
+    assert(neiron_count <= max_neirons && input_count <= max_neirons);
+
+    uint32_t slice_count = (neiron_count + slice_size - 1) / slice_size;
+    act_level.assign(slice_count * slice_size, 0);
+    std::copy(levels.begin(), levels.end(), act_level.begin());
+
+    std::vector<uint32_t> count(2 * act_level.size(), 0);
+    for(const auto &link : links)count[2 * link.output + (link.input >= neiron_count)]++;
+
+    uint32_t pos = 0;  parts.resize(2 * slice_count + 1);
+    for(uint32_t s = 0; s < slice_count; s++)
+    {
+        uint32_t n_bin = 0, n_gen = 0;
+        for(uint32_t i = s * slice_size; i < (s + 1) * slice_size; i++)
+        {
+            n_bin = std::max(n_bin, count[2 * i]);
+            n_gen = std::max(n_gen, count[2 * i + 1]);
+        }
+        parts[2 * s] = pos;  pos += n_bin * slice_size;
+        parts[2 * s + 1] = pos;  pos += (n_gen + 1) / 2 * 2 * slice_size;
+    }
+    parts[2 * slice_count] = pos;
+
+    source.assign(pos, 0);  weight.assign(pos, 0);
+    std::fill(count.begin(), count.end(), 0);
+    for(const auto &link : links)
+    {
+        uint32_t s = link.output / slice_size, lane = link.output % slice_size;
+        uint32_t index;
+        if(link.input < neiron_count)
+        {
+            uint32_t k = count[2 * link.output]++;
+            index = parts[2 * s] + k * slice_size + lane;
+        }
+        else
+        {
+            uint32_t k = count[2 * link.output + 1]++;
+            index = parts[2 * s + 1] + (k >> 1) * 2 * slice_size + 2 * lane + (k & 1);
+        }
+        source[index] = link.input;  weight[index] = link.weight;
+    }
+
+    fan_start.assign(input_count + 1, 0);
+    for(const auto &link : links)fan_start[link.input + 1]++;
+    for(uint32_t i = 0; i < input_count; i++)fan_start[i + 1] += fan_start[i];
+    fanout.resize(links.size());
+    std::vector<uint32_t> fill(fan_start.begin(), fan_start.end() - 1);
+    for(const auto &link : links)fanout[fill[link.input]++] = {link.output, link.weight};
+
+    uint64_t hash = uint64_t(neiron_count) << 32 | input_count;
+    auto mix = [&hash](uint64_t val)
+    {
+        hash = (hash ^ val) * 0x9E3779B97F4A7C15ull;  hash ^= hash >> 29;
+    };
+    for(int32_t level : act_level)mix(uint32_t(level));
+    for(uint32_t part : parts)mix(part);
+    for(size_t i = 0; i < source.size(); i++)mix(uint32_t(source[i]) << 16 | uint16_t(weight[i]));
+    identity = hash;
+}
+
+bool Network::operator == (const Network &cmp) const
+{
+    return identity == cmp.identity && neiron_count == cmp.neiron_count && input_count == cmp.input_count &&
+        act_level == cmp.act_level && parts == cmp.parts && source == cmp.source && weight == cmp.weight;
+}
+
+
+void Network::execute_scalar(uint8_t *input) const
+{
+    uint8_t output[max_neirons];
+    for(uint32_t s = 0; 2 * s + 1 < parts.size(); s++)
+    {
+        int32_t level[slice_size] = {};
+        for(uint32_t i = parts[2 * s]; i < parts[2 * s + 1]; i++)
+            level[i % slice_size] += weight[i] * int16_t(input[source[i]]);
+        for(uint32_t i = parts[2 * s + 1]; i < parts[2 * s + 2]; i++)
+            level[(i - parts[2 * s + 1]) / 2 % slice_size] += weight[i] * int16_t(input[source[i]]);
+
+        const int32_t *act = act_level.data() + s * slice_size;
+        for(uint32_t k = 0; k < slice_size; k++)
+            output[s * slice_size + k] = level[k] > act[k] ? 255 : 0;
+    }
+    std::memcpy(input, output, neiron_count);
+}
+
+
+#ifdef NETWORK_SIMD
+
+TARGET("sse4.1") void execute_sse41(const Network &net, uint8_t *input)
+{
+    alignas(16) uint8_t output[Network::max_neirons];
+    alignas(16) int16_t val[2 * Network::slice_size];
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi32(255);
+    for(uint32_t s = 0; 2 * s + 1 < net.parts.size(); s++)
+    {
+        __m128i lo = zero, hi = zero;
+        for(uint32_t i = net.parts[2 * s]; i < net.parts[2 * s + 1]; i += Network::slice_size)
+        {
+            for(uint32_t k = 0; k < Network::slice_size; k++)val[k] = input[net.source[i + k]];
+            __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(net.weight.data() + i));
+            w = _mm_and_si128(w, _mm_cmpgt_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(val)), zero));
+            lo = _mm_add_epi32(lo, _mm_cvtepi16_epi32(w));
+            hi = _mm_add_epi32(hi, _mm_cvtepi16_epi32(_mm_srli_si128(w, 8)));
+        }
+        lo = _mm_mullo_epi32(lo, mul);  hi = _mm_mullo_epi32(hi, mul);
+
+        for(uint32_t i = net.parts[2 * s + 1]; i < net.parts[2 * s + 2]; i += 2 * Network::slice_size)
+        {
+            for(uint32_t k = 0; k < 2 * Network::slice_size; k++)val[k] = input[net.source[i + k]];
+            const __m128i *w = reinterpret_cast<const __m128i *>(net.weight.data() + i);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(val)), _mm_loadu_si128(w)));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(val + 8)), _mm_loadu_si128(w + 1)));
+        }
+
+        const __m128i *act = reinterpret_cast<const __m128i *>(net.act_level.data() + s * Network::slice_size);
+        lo = _mm_cmpgt_epi32(lo, _mm_loadu_si128(act));
+        hi = _mm_cmpgt_epi32(hi, _mm_loadu_si128(act + 1));
+        __m128i res = _mm_packs_epi16(_mm_packs_epi32(lo, hi), zero);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(output + s * Network::slice_size), res);
+    }
+    std::memcpy(input, output, net.neiron_count);
+}
+
+TARGET("avx2") void execute_avx2(const Network &net, uint8_t *input)
+{
+    alignas(32) uint8_t output[Network::max_neirons];
+    alignas(32) int16_t val[2 * Network::slice_size];
+    alignas(32) uint32_t mask[Network::max_neirons / 32] = {};
+
+    // neiron outputs are 0 or 255 (every mode writes them that way and sensors never land here),
+    // so bit 7 tested by movemask is equivalent to the "> 0" test of the scalar and SSE4.1 kernels
+    uint32_t n = net.neiron_count, pos = 0;
+    assert(std::all_of(input, input + n, [](uint8_t val) { return !val || val == 255; }));
+    for(; pos + 32 <= n; pos += 32)
+        mask[pos / 32] = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + pos)));
+    for(; pos < n; pos++)mask[pos / 32] |= uint32_t(input[pos] >> 7) << (pos % 32);
+
+    const __m256i bits = _mm256_load_si256(reinterpret_cast<const __m256i *>(mask));
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1), low = _mm256_set1_epi32(31);
+    const __m256i mul = _mm256_set1_epi32(255);
+    for(uint32_t s = 0; 2 * s + 1 < net.parts.size(); s++)
+    {
+        __m256i level = zero;
+        for(uint32_t i = net.parts[2 * s]; i < net.parts[2 * s + 1]; i += Network::slice_size)
+        {
+            __m256i src = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(net.source.data() + i)));
+            __m256i bit = _mm256_permutevar8x32_epi32(bits, _mm256_srli_epi32(src, 5));
+            bit = _mm256_and_si256(_mm256_srlv_epi32(bit, _mm256_and_si256(src, low)), one);
+            __m256i w = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(net.weight.data() + i)));
+            level = _mm256_add_epi32(level, _mm256_and_si256(w, _mm256_sub_epi32(zero, bit)));
+        }
+        level = _mm256_mullo_epi32(level, mul);
+
+        for(uint32_t i = net.parts[2 * s + 1]; i < net.parts[2 * s + 2]; i += 2 * Network::slice_size)
+        {
+            for(uint32_t k = 0; k < 2 * Network::slice_size; k++)val[k] = input[net.source[i + k]];
+            __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(net.weight.data() + i));
+            level = _mm256_add_epi32(level, _mm256_madd_epi16(_mm256_load_si256(reinterpret_cast<const __m256i *>(val)), w));
+        }
+
+        const int32_t *act = net.act_level.data() + s * Network::slice_size;
+        level = _mm256_cmpgt_epi32(level, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(act)));
+        __m128i res = _mm_packs_epi32(_mm256_castsi256_si128(level), _mm256_extracti128_si256(level, 1));
+        res = _mm_packs_epi16(res, _mm_setzero_si128());
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(output + s * Network::slice_size), res);
+    }
+    std::memcpy(input, output, net.neiron_count);
+}
+
+
+TARGET("avx2") void execute_batch_avx2(const Network &net, uint8_t *const *input, uint32_t count)
+{
+    constexpr uint32_t batch_size = Network::batch_size;
+    alignas(32) uint8_t val[Network::max_neirons][batch_size];
+    alignas(32) int32_t level[Network::max_neirons][batch_size];
+
+    for(uint32_t i = 0; i < net.input_count; i++)
+        for(uint32_t k = 0; k < count; k++)val[i][k] = input[k][i];
+    for(uint32_t i = 0; i < net.input_count; i++)
+        for(uint32_t k = count; k < batch_size; k++)val[i][k] = 0;
+
+    const __m256i zero = _mm256_setzero_si256();
+    for(uint32_t i = 0; i < net.neiron_count; i++)
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(level[i]), zero);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(level[i] + 8), zero);
+    }
+    for(uint32_t i = 0; i < net.input_count; i++)
+    {
+        __m128i row = _mm_load_si128(reinterpret_cast<const __m128i *>(val[i]));
+        if(_mm_testz_si128(row, row))continue;
+
+        __m256i x = _mm256_cvtepu8_epi16(row);
+        for(uint32_t j = net.fan_start[i]; j < net.fan_start[i + 1]; j++)
+        {
+            __m256i prod = _mm256_mullo_epi16(x, _mm256_set1_epi16(net.fanout[j].weight));
+            __m256i *dst = reinterpret_cast<__m256i *>(level[net.fanout[j].output]);
+            dst[0] = _mm256_add_epi32(dst[0], _mm256_cvtepi16_epi32(_mm256_castsi256_si128(prod)));
+            dst[1] = _mm256_add_epi32(dst[1], _mm256_cvtepi16_epi32(_mm256_extracti128_si256(prod, 1)));
+        }
+    }
+    for(uint32_t i = 0; i < net.neiron_count; i++)
+        for(uint32_t k = 0; k < count; k++)input[k][i] = level[i][k] > net.act_level[i] ? 255 : 0;
+}
+
+
+bool cpu_supports(Network::Kernel kernel)
+{
+#ifdef _MSC_VER
+    int info[4];  __cpuid(info, 0);  int max_leaf = info[0];
+    __cpuid(info, 1);  bool sse41 = info[2] & 1 << 19;
+    if(kernel == Network::k_sse41)return sse41;
+    if(!(info[2] & 1 << 27) || !(info[2] & 1 << 28) || (_xgetbv(0) & 6) != 6 || max_leaf < 7)return false;
+    __cpuidex(info, 7, 0);  return sse41 && (info[1] & 1 << 5);
+#else
+    __builtin_cpu_init();
+    if(kernel == Network::k_sse41)return __builtin_cpu_supports("sse4.1");
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+
+void execute_scalar(const Network &net, uint8_t *input)
+{
+    net.execute_scalar(input);
+}
+
+void execute_batch_scalar(const Network &net, uint8_t *const *input, uint32_t count)
+{
+    constexpr uint32_t batch_size = Network::batch_size;
+    uint8_t val[Network::max_neirons][batch_size];
+    int32_t level[Network::max_neirons][batch_size];
+
+    for(uint32_t i = 0; i < net.input_count; i++)
+        for(uint32_t k = 0; k < count; k++)val[i][k] = input[k][i];
+    for(uint32_t i = 0; i < net.neiron_count; i++)
+        for(uint32_t k = 0; k < count; k++)level[i][k] = 0;
+
+    for(uint32_t i = 0; i < net.input_count; i++)
+        for(uint32_t j = net.fan_start[i]; j < net.fan_start[i + 1]; j++)
+        {
+            int32_t w = net.fanout[j].weight, *dst = level[net.fanout[j].output];
+            for(uint32_t k = 0; k < count; k++)dst[k] += w * val[i][k];
+        }
+    for(uint32_t i = 0; i < net.neiron_count; i++)
+        for(uint32_t k = 0; k < count; k++)input[k][i] = level[i][k] > net.act_level[i] ? 255 : 0;
+}
+
+typedef void (*KernelProc)(const Network &net, uint8_t *input);
+typedef void (*BatchProc)(const Network &net, uint8_t *const *input, uint32_t count);
+
+KernelProc kernel_proc(Network::Kernel kernel)
+{
+    switch(kernel)
+    {
+#ifdef NETWORK_SIMD
+    case Network::k_sse41:  return cpu_supports(kernel) ? execute_sse41 : nullptr;
+    case Network::k_avx2:   return cpu_supports(kernel) ? execute_avx2 : nullptr;
+#endif
+    case Network::k_scalar:  return execute_scalar;
+    default:  return nullptr;
+    }
+}
+
+Network::Kernel Network::best_kernel()
+{
+    if(kernel_proc(k_avx2))return k_avx2;
+    if(kernel_proc(k_sse41))return k_sse41;
+    return k_scalar;
+}
+
+BatchProc batch_proc(Network::Kernel kernel)
+{
+#ifdef NETWORK_SIMD
+    if(kernel == Network::k_avx2)return execute_batch_avx2;
+#endif
+    (void)kernel;  return execute_batch_scalar;
+}
+
+KernelProc current_kernel = kernel_proc(Network::best_kernel());
+BatchProc current_batch = batch_proc(Network::best_kernel());
+
+bool Network::select_kernel(Kernel kernel)
+{
+    KernelProc proc = kernel_proc(kernel);
+    if(!proc)return false;
+    current_kernel = proc;  current_batch = batch_proc(kernel);  return true;
+}
+
+
+void Network::execute_full(State &state, uint8_t *input) const
+{
+    state.valid = false;  current_kernel(*this, input);  // incremental state goes stale
+}
+
+void Network::execute_incremental(State &state, uint8_t *input) const
+{
+    // invariant: state.level[i] is the level of neiron i for inputs in state.input
+
+    if(!state.valid)
+    {
+        state.level.assign(neiron_count, 0);
+        for(uint32_t i = 0; i < input_count; i++)
+            for(uint32_t j = fan_start[i]; j < fan_start[i + 1]; j++)
+                state.level[fanout[j].output] += fanout[j].weight * int16_t(input[i]);
+        state.input.assign(input, input + input_count);  state.valid = true;
+
+        for(uint32_t i = 0; i < neiron_count; i++)
+            input[i] = state.level[i] > act_level[i] ? 255 : 0;
+        return;
+    }
+
+    uint64_t dirty[max_neirons / 64] = {};
+    for(uint32_t i = 0; i < input_count; i++)
+    {
+        int32_t delta = int32_t(input[i]) - state.input[i];
+        if(!delta)continue;
+
+        state.input[i] = input[i];
+        for(uint32_t j = fan_start[i]; j < fan_start[i + 1]; j++)
+        {
+            uint32_t k = fanout[j].output;
+            state.level[k] += fanout[j].weight * delta;
+            dirty[k >> 6] |= uint64_t(1) << (k & 63);
+        }
+    }
+    for(uint32_t w = 0; w < max_neirons / 64; w++)
+        for(uint64_t bits = dirty[w]; bits; bits &= bits - 1)
+        {
+            uint32_t k = 64 * w + ilog2(bits & -bits);
+            input[k] = state.level[k] > act_level[k] ? 255 : 0;
+        }
+}
+
+
+
+// JIT compiler
+
+typedef void (*CodeProc)(uint8_t *input);
+
+struct Network::Code
+{
+    Network key;
+    void *mem;  size_t size;
+    CodeProc proc;
+
+    Code(const Network &net) : key(net), mem(nullptr), size(0), proc(nullptr)
+    {
+        key.code.reset();
+    }
+
+    ~Code()
+    {
+#ifdef NETWORK_JIT
+        if(mem)munmap(mem, size);
+#endif
+    }
+
+    Code(const Code &) = delete;
+    Code &operator = (const Code &) = delete;
+};
+
+#ifdef NETWORK_JIT
+
+class Encoder
+{
+    std::vector<uint8_t> buf;
+
+public:
+    Encoder &operator << (uint8_t val)
+    {
+        buf.push_back(val);  return *this;
+    }
+
+    void put32(uint32_t val)
+    {
+        for(int i = 0; i < 32; i += 8)buf.push_back(val >> i);
+    }
+
+    // code for void proc(uint8_t *input), input in rdi, output buffer on stack
+    void compile(const Network &net);
+    void flush(Network::Code &code);
+};
+
+void Encoder::compile(const Network &net)
+{
+    *this << 0x48 << 0x81 << 0xEC;  put32(Network::max_neirons);  // sub rsp, 256
+    for(uint32_t s = 0; 2 * s + 1 < net.parts.size(); s++)
+        for(uint32_t lane = 0; lane < Network::slice_size; lane++)
+        {
+            uint32_t index = s * Network::slice_size + lane;
+            if(index >= net.neiron_count)break;
+
+            *this << 0x31 << 0xC0;  // xor eax, eax
+            auto emit_link = [this, &net](uint32_t pos)
+            {
+                if(!net.weight[pos])return;
+                *this << 0x0F << 0xB6 << 0x8F;  put32(net.source[pos]);  // movzx ecx, byte [rdi + src]
+                *this << 0x6B << 0xC9 << uint8_t(net.weight[pos]);     // imul ecx, ecx, weight
+                *this << 0x01 << 0xC8;                                  // add eax, ecx
+            };
+            for(uint32_t i = net.parts[2 * s] + lane; i < net.parts[2 * s + 1]; i += Network::slice_size)
+                emit_link(i);
+            for(uint32_t i = net.parts[2 * s + 1] + 2 * lane; i < net.parts[2 * s + 2]; i += 2 * Network::slice_size)
+            {
+                emit_link(i);  emit_link(i + 1);
+            }
+
+            *this << 0x3D;  put32(net.act_level[index]);  // cmp eax, act_level
+            *this << 0x0F << 0x9F << 0xC1;                  // setg cl
+            *this << 0xF6 << 0xD9;                          // neg cl
+            *this << 0x88 << 0x8C << 0x24;  put32(index);   // mov [rsp + index], cl
+        }
+
+    uint32_t pos = 0;
+    for(; pos + 8 <= net.neiron_count; pos += 8)
+    {
+        *this << 0x48 << 0x8B << 0x84 << 0x24;  put32(pos);  // mov rax, [rsp + pos]
+        *this << 0x48 << 0x89 << 0x87;  put32(pos);          // mov [rdi + pos], rax
+    }
+    for(; pos < net.neiron_count; pos++)
+    {
+        *this << 0x8A << 0x84 << 0x24;  put32(pos);  // mov al, [rsp + pos]
+        *this << 0x88 << 0x87;  put32(pos);          // mov [rdi + pos], al
+    }
+    *this << 0x48 << 0x81 << 0xC4;  put32(Network::max_neirons);  // add rsp, 256
+    *this << 0xC3;  // ret
+}
+
+void Encoder::flush(Network::Code &code)
+{
+    size_t page = 4096, size = (buf.size() + page - 1) & ~(page - 1);
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED)return;
+
+    std::memcpy(mem, buf.data(), buf.size());
+    if(mprotect(mem, size, PROT_READ | PROT_EXEC))
+    {
+        munmap(mem, size);  return;
+    }
+    code.mem = mem;  code.size = size;
+    std::memcpy(&code.proc, &mem, sizeof(code.proc));
+}
+
+#endif
+
+
+std::mutex code_mutex;
+std::unordered_map<uint64_t, std::weak_ptr<const Network::Code>> code_cache;
+size_t code_cache_limit = 1024;
+
+std::shared_ptr<const Network::Code> compile(const Network &net)
+{
+    std::unique_lock<std::mutex> lock(code_mutex);
+    auto &entry = code_cache[net.identity];
+    if(auto code = entry.lock())
+        if(code->key == net)return code;
+
+    std::shared_ptr<Network::Code> code = std::make_shared<Network::Code>(net);
+#ifdef NETWORK_JIT
+    Encoder enc;  enc.compile(net);  enc.flush(*code);
+#endif
+    if(entry.expired())entry = code;
+
+    if(code_cache.size() > code_cache_limit)
+    {
+        for(auto ptr = code_cache.begin(); ptr != code_cache.end();)
+            if(ptr->second.expired())ptr = code_cache.erase(ptr);
+            else ++ptr;
+        code_cache_limit = std::max<size_t>(1024, 2 * code_cache.size());
+    }
+    return code;
+}
+
+void Network::execute_jit(State &state, uint8_t *input) const
+{
+    if(!code)code = compile(*this);
+    if(code->proc)code->proc(input);
+    else current_kernel(*this, input);
+    state.valid = false;
+}
+
+
+typedef void (Network::*ModeProc)(Network::State &state, uint8_t *input) const;
+
+ModeProc current_mode = &Network::execute_full;
+bool batch_enabled = false;
+
+bool Network::select_mode(Mode mode)
+{
+    switch(mode)
+    {
+    case m_incremental:  current_mode = &Network::execute_incremental;  return true;
+#ifdef NETWORK_JIT
+    case m_jit:          current_mode = &Network::execute_jit;  return true;
+#endif
+    case m_full:         current_mode = &Network::execute_full;  return true;
+    default:             return false;
+    }
+}
+
+void Network::enable_batching(bool enable)
+{
+    batch_enabled = enable;
+}
+
+bool Network::batching()
+{
+    return batch_enabled;
+}
+
+void Network::execute(State &state, uint8_t *input) const
+{
+#ifdef DEBUG
+    std::vector<uint8_t> check(input, input + input_count);
+    execute_scalar(check.data());
+    (this->*current_mode)(state, input);
+    assert(!std::memcmp(check.data(), input, neiron_count));
+#else
+    (this->*current_mode)(state, input);
+#endif
+}
+
+void Network::execute_batch(uint8_t *const *input, uint32_t count) const
+{
+#ifdef DEBUG
+    std::vector<uint8_t> check;
+    for(uint32_t k = 0; k < count; k++)
+    {
+        check.insert(check.end(), input[k], input[k] + input_count);
+        execute_scalar(check.data() + k * input_count);
+    }
+#endif
+    for(uint32_t pos = 0; pos < count; pos += batch_size)
+        current_batch(*this, input + pos, std::min(count - pos, uint32_t(batch_size)));
+#ifdef DEBUG
+    for(uint32_t k = 0; k < count; k++)
+        assert(!std::memcmp(check.data() + k * input_count, input[k], neiron_count));
+#endif
+}
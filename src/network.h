@@ -0,0 +1,94 @@
+// network.h : neural network evaluation
+//
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "evo_math.h"
+
+
+
+struct Network
+{
+    enum Kernel
+    {
+        k_scalar, k_sse41, k_avx2
+    };
+
+    enum Mode
+    {
+        m_full, m_incremental, m_jit
+    };
+
+    struct Code;
+
+    struct Link
+    {
+        uint8_t input, output;
+        int8_t weight;
+
+        Link(uint8_t input, uint8_t output, int8_t weight) : input(input), output(output), weight(weight)
+        {
+        }
+    };
+
+    struct Fanout
+    {
+        uint8_t output;
+        int16_t weight;
+    };
+
+    struct State
+    {
+        std::vector<int32_t> level;
+        std::vector<uint8_t> input;
+        bool valid;
+
+        State() : valid(false)
+        {
+        }
+    };
+
+    static constexpr uint32_t max_neirons = 256;
+    static constexpr uint32_t slice_size = 8;
+    static constexpr uint32_t batch_size = 16;
+
+    // Links are stored in slices of 8 output neirons (sliced CSR).
+    // Every slice has two parts: links from neirons (inputs are 0 or 255)
+    // in columns of 8 (one link per output) and links from sensors
+    // in columns of 16 (two consecutive links per output).
+    // Unused lanes have zero weight.
+    // For incremental and batched modes the same links are also grouped by input.
+
+    uint64_t identity;
+    uint32_t neiron_count, input_count;
+    std::vector<int32_t> act_level;
+    std::vector<uint32_t> parts;
+    std::vector<uint8_t> source;
+    std::vector<int16_t> weight;
+    std::vector<uint32_t> fan_start;
+    std::vector<Fanout> fanout;
+    mutable std::shared_ptr<const Code> code;
+
+
+    Network() : identity(0), neiron_count(0), input_count(0)
+    {
+    }
+
+    void build(const std::vector<int32_t> &levels, uint32_t input_count, const std::vector<Link> &links);
+    bool operator == (const Network &cmp) const;
+
+    void execute_scalar(uint8_t *input) const;
+    void execute_full(State &state, uint8_t *input) const;
+    void execute_incremental(State &state, uint8_t *input) const;
+    void execute_jit(State &state, uint8_t *input) const;
+    void execute(State &state, uint8_t *input) const;
+    void execute_batch(uint8_t *const *input, uint32_t count) const;  // doesn't update states, caller invalidates them
+
+    static Kernel best_kernel();
+    static bool select_kernel(Kernel kernel);
+    static bool select_mode(Mode mode);
+    static void enable_batching(bool enable);
+    static bool batching();
+};
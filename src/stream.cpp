@@ -4,6 +4,23 @@
 #include <algorithm>
 #include "stream.h"
 
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define STREAM_URING
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
 
 
 // OutStream class
@@ -19,7 +36,7 @@ void OutStream::put_overflow(const char *data, size_t size)
     while(size > avail)
     {
         std::memcpy(buf.data() + pos, data, avail);
-        for(size_t offs = 0; offs < buf.size(); offs += Hash::block_size)
+        if(hashed)for(size_t offs = 0; offs < buf.size(); offs += Hash::block_size)
             hash.process_block(buf.data() + offs);
 
         overflow(buf.data(), buf.size(), false);  pos = 0;
@@ -30,10 +47,13 @@ void OutStream::put_overflow(const char *data, size_t size)
 
 void OutStream::finalize()
 {
-    size_t offs = 0;
-    for(; offs + Hash::block_size < pos; offs += Hash::block_size)
-        hash.process_block(buf.data() + offs);
-    hash.process_last(buf.data() + offs, pos - offs);
+    if(hashed)
+    {
+        size_t offs = 0;
+        for(; offs + Hash::block_size < pos; offs += Hash::block_size)
+            hash.process_block(buf.data() + offs);
+        hash.process_last(buf.data() + offs, pos - offs);
+    }
     overflow(buf.data(), pos, true);
 }
 
@@ -44,23 +64,12 @@ void OutStream::finalize()
 bool InStream::load_buffer()
 {
     pos = 0;
-    ready = underflow(buf.data(), buf.size());
+    ready = underflow_span(window, span);
     if(!ready)return false;
 
-    last = (ready <= buf.size());
-    if(last)
-    {
-        size_t offs = 0;
-        for(; offs + Hash::block_size < ready; offs += Hash::block_size)
-            hash.process_block(buf.data() + offs);
-        hash.process_last(buf.data() + offs, ready - offs);
-    }
-    else
-    {
-        ready = buf.size();
-        for(size_t offs = 0; offs < buf.size(); offs += Hash::block_size)
-            hash.process_block(buf.data() + offs);
-    }
+    last = (ready <= span);
+    if(!last)ready = span;
+    if(hashed)hash.process_span(window, ready, last);
     return true;
 }
 
@@ -80,18 +89,17 @@ bool InStream::get_underflow(char *data, size_t size)
         {
             pos = ready = 0;  return false;
         }
-        std::memcpy(data, buf.data() + pos, avail);
+        std::memcpy(data, window + pos, avail);
         if(!load_buffer())return false;
 
         data += avail;  size -= avail;  avail = ready;
     }
-    std::memcpy(data, buf.data() + pos, size);  pos += size;  return true;
+    std::memcpy(data, window + pos, size);  pos += size;  return true;
 }
 
 bool InStream::finalize(const void *checksum)
 {
-    return ready && pos == ready && last &&
-        !std::memcmp(hash.result(), checksum, Hash::result_size);
+    return at_end() && !std::memcmp(hash.result(), checksum, Hash::result_size);
 }
 
 
@@ -117,11 +125,12 @@ bool OutFileStream::open(const char *path)
 
 void OutFileStream::overflow(const char *data, size_t size, bool last)
 {
+    // checksum is final with the last buffer only
     if(!file)
         return;
-    auto r1 = ( std::fwrite(data, 1, size, file) != size );
-    auto r2 = (std::fwrite(checksum(), 1, Hash::result_size, file) != Hash::result_size );
-    if( r1 || (last && r2) )
+    if(std::fwrite(data, 1, size, file) != size)
+        error();
+    else if(last && std::fwrite(checksum(), 1, Hash::result_size, file) != Hash::result_size)
         error();
 }
 
@@ -168,3 +177,417 @@ bool InFileStream::close()
     bool res = !std::fclose(file) && finalize(checksum);
     file = nullptr;  return res;
 }
+
+
+
+// InMapStream class
+
+void InMapStream::set_size()
+{
+    // last frame has 1 to frame_size bytes followed by the final checksum
+
+    size_t frames = framed ? 1 + (map_size - Hash::result_size - 1) / (frame_size + Hash::result_size) : 1;
+    total_size = map_size - frames * Hash::result_size;  offs = 0;
+}
+
+size_t InMapStream::underflow_span(const char *&data, size_t size)
+{
+    size_t left = total_size - offs;
+    data = map + offs + (framed ? offs / frame_size * Hash::result_size : 0);
+    offs += std::min(size, left);  return left;
+}
+
+#ifdef _WIN32
+
+bool InMapStream::open(const char *path)
+{
+    // no mapping, the file is read at once
+
+    assert(!map);
+    FILE *file = std::fopen(path, "rb");  if(!file)return false;
+    char buf[1 << 16];  content.clear();
+    for(size_t n; (n = std::fread(buf, 1, sizeof(buf), file));)content.insert(content.end(), buf, buf + n);
+    bool res = !std::ferror(file) && content.size() > Hash::result_size;
+    std::fclose(file);  if(!res)return false;
+
+    map = content.data();  map_size = content.size();
+    set_size();  initialize();  return true;
+}
+
+bool InMapStream::close()
+{
+    if(!map)return false;
+    bool res = finalize(map + map_size - Hash::result_size);
+    std::vector<char>().swap(content);  map = nullptr;  return res;
+}
+
+#else
+
+bool InMapStream::open(const char *path)
+{
+    assert(!map);
+    int fd = ::open(path, O_RDONLY);  if(fd < 0)return false;
+    struct stat info;  void *ptr = MAP_FAILED;
+    if(!fstat(fd, &info) && info.st_size > off_t(Hash::result_size))
+        ptr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  if(ptr == MAP_FAILED)return false;
+
+    madvise(ptr, info.st_size, MADV_SEQUENTIAL);
+    madvise(ptr, info.st_size, MADV_WILLNEED);
+    map = static_cast<const char *>(ptr);  map_size = info.st_size;
+    set_size();  initialize();  return true;
+}
+
+bool InMapStream::close()
+{
+    if(!map)return false;
+    bool res = finalize(map + map_size - Hash::result_size);
+    munmap(const_cast<char *>(map), map_size);  map = nullptr;  return res;
+}
+
+#endif
+
+
+
+// ChunkFile class
+
+#ifdef _WIN32
+
+ChunkFile::ChunkFile() : file(nullptr)
+{
+}
+
+bool ChunkFile::is_open() const
+{
+    return file;
+}
+
+bool ChunkFile::open(const char *path)
+{
+    assert(!file);  file = std::fopen(path, "rb");  return file;
+}
+
+bool ChunkFile::create(const char *path)
+{
+    assert(!file);  file = std::fopen(path, "wb");  return file;
+}
+
+bool ChunkFile::size(uint64_t &res) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(_fseeki64(file, 0, SEEK_END))return false;
+    int64_t pos = _ftelli64(file);  res = pos;  return pos >= 0;
+}
+
+bool ChunkFile::read(uint64_t offset, void *data, size_t size) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return !_fseeki64(file, offset, SEEK_SET) && std::fread(data, 1, size, file) == size;
+}
+
+bool ChunkFile::write(uint64_t offset, const void *data, size_t size) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return !_fseeki64(file, offset, SEEK_SET) && std::fwrite(data, 1, size, file) == size;
+}
+
+void ChunkFile::release(uint64_t offset, uint64_t size, bool written) const
+{
+    (void)offset;  (void)size;  (void)written;
+}
+
+bool ChunkFile::close()
+{
+    if(!file)return false;
+    bool res = !std::fclose(file);  file = nullptr;  return res;
+}
+
+#else
+
+ChunkFile::ChunkFile() : fd(-1)
+{
+}
+
+bool ChunkFile::is_open() const
+{
+    return fd >= 0;
+}
+
+bool ChunkFile::open(const char *path)
+{
+    assert(fd < 0);  fd = ::open(path, O_RDONLY);  return fd >= 0;
+}
+
+bool ChunkFile::create(const char *path)
+{
+    assert(fd < 0);  fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);  return fd >= 0;
+}
+
+bool ChunkFile::size(uint64_t &res) const
+{
+    struct stat info;  if(fstat(fd, &info))return false;
+    res = info.st_size;  return true;
+}
+
+int64_t read_all(int fd, uint64_t offset, char *data, size_t size)
+{
+    // stops at the end of file
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t n = pread(fd, data + done, size - done, offset + done);
+        if(n < 0)
+        {
+            if(errno == EINTR)continue;
+            return -errno;
+        }
+        if(!n)break;
+        done += n;
+    }
+    return done;
+}
+
+int64_t write_all(int fd, uint64_t offset, const char *data, size_t size)
+{
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t n = pwrite(fd, data + done, size - done, offset + done);
+        if(n < 0)
+        {
+            if(errno == EINTR)continue;
+            return -errno;
+        }
+        done += n;
+    }
+    return done;
+}
+
+bool ChunkFile::read(uint64_t offset, void *data, size_t size) const
+{
+    return read_all(fd, offset, static_cast<char *>(data), size) == int64_t(size);
+}
+
+bool ChunkFile::write(uint64_t offset, const void *data, size_t size) const
+{
+    return write_all(fd, offset, static_cast<const char *>(data), size) == int64_t(size);
+}
+
+void ChunkFile::release(uint64_t offset, uint64_t size, bool written) const
+{
+    // dirty pages stay cached, failures too: it's only a hint
+#ifdef __linux__
+    const unsigned flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+    if(written)sync_file_range(fd, offset, size, flags);
+#else
+    (void)written;
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, offset, size, POSIX_FADV_DONTNEED);
+#else
+    (void)offset;  (void)size;
+#endif
+}
+
+bool ChunkFile::close()
+{
+    if(fd < 0)return false;
+    bool res = !::close(fd);  fd = -1;  return res;
+}
+
+#endif
+
+
+
+// FileQueue class
+
+#ifdef STREAM_URING
+
+struct FileQueue::State
+{
+    struct Request  // rest of a read or write, short transfers are resubmitted
+    {
+        uint64_t offset;
+        char *data;
+        size_t size;
+        uint8_t opcode;
+    };
+
+    int ring;
+    void *sq_map, *cq_map, *sqe_map;
+    size_t sq_map_size, cq_map_size, sqe_map_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    std::vector<Request> requests;  // user data of entries is the index
+    std::vector<unsigned> free;
+
+    State() : ring(-1), sq_map(MAP_FAILED), cq_map(MAP_FAILED), sqe_map(MAP_FAILED)
+    {
+    }
+
+    ~State()
+    {
+        if(sqe_map != MAP_FAILED)munmap(sqe_map, sqe_map_size);
+        if(cq_map != MAP_FAILED)munmap(cq_map, cq_map_size);
+        if(sq_map != MAP_FAILED)munmap(sq_map, sq_map_size);
+        if(ring >= 0)::close(ring);
+    }
+
+    bool setup(unsigned depth);
+    bool submit(int fd, unsigned slot);
+    unsigned complete(int64_t &res);
+};
+
+bool FileQueue::State::setup(unsigned depth)
+{
+    io_uring_params params;  std::memset(&params, 0, sizeof(params));
+    ring = syscall(__NR_io_uring_setup, depth, &params);  if(ring < 0)return false;
+    if(!(params.features & IORING_FEAT_RW_CUR_POS))return false;  // no IORING_OP_READ/WRITE before that
+
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqe_map_size = params.sq_entries * sizeof(io_uring_sqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single)sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+
+    const int prot = PROT_READ | PROT_WRITE, flags = MAP_SHARED | MAP_POPULATE;
+    sq_map = mmap(nullptr, sq_map_size, prot, flags, ring, IORING_OFF_SQ_RING);  if(sq_map == MAP_FAILED)return false;
+    if(!single)
+    {
+        cq_map = mmap(nullptr, cq_map_size, prot, flags, ring, IORING_OFF_CQ_RING);  if(cq_map == MAP_FAILED)return false;
+    }
+    sqe_map = mmap(nullptr, sqe_map_size, prot, flags, ring, IORING_OFF_SQES);  if(sqe_map == MAP_FAILED)return false;
+
+    char *sq = static_cast<char *>(sq_map), *cq = static_cast<char *>(single ? sq_map : cq_map);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    sqes = static_cast<io_uring_sqe *>(sqe_map);
+
+    requests.resize(depth);  free.resize(depth);
+    for(unsigned i = 0; i < depth; i++)free[i] = depth - 1 - i;
+    return true;
+}
+
+bool FileQueue::State::submit(int fd, unsigned slot)
+{
+    // in-flight requests never exceed the ring size, so there is always a free entry,
+    // an entry the kernel hasn't consumed is taken back, the ring stays as if it were never published
+
+    const Request &req = requests[slot];
+    unsigned tail = *sq_tail, index = tail & *sq_mask;
+    io_uring_sqe &sqe = sqes[index];  std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = req.opcode;  sqe.fd = fd;  sqe.off = req.offset;
+    sqe.addr = reinterpret_cast<uintptr_t>(req.data);  sqe.len = req.size;  sqe.user_data = slot;
+    sq_array[index] = index;  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while(syscall(__NR_io_uring_enter, ring, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR);
+    if(__atomic_load_n(sq_head, __ATOMIC_ACQUIRE) != tail)return true;
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);  return false;
+}
+
+unsigned FileQueue::State::complete(int64_t &res)
+{
+    // buffers of requests in flight belong to the kernel until their completions,
+    // so they are polled for if waiting fails, file I/O always completes
+
+    for(;;)
+    {
+        unsigned head = *cq_head;
+        if(head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe &cqe = cqes[head & *cq_mask];  unsigned slot = cqe.user_data;  res = cqe.res;
+            __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);  return slot;
+        }
+        if(syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            sched_yield();
+    }
+}
+
+#else
+
+struct FileQueue::State
+{
+};
+
+#endif
+
+
+FileQueue::FileQueue(const ChunkFile &file, unsigned depth) :
+    file(file), depth(depth), in_flight(0), range_start(-1), range_end(0), written(false), failed(false)
+{
+    assert(file.is_open());
+#ifdef STREAM_URING
+    if(!depth)return;
+    state.reset(new State);  if(!state->setup(depth))state.reset();
+#endif
+}
+
+FileQueue::~FileQueue()
+{
+    wait();
+}
+
+void FileQueue::reap()
+{
+    // short transfer continues with the rest, end of file or error fails the request,
+    // the rest the ring doesn't take is done in place
+
+#ifdef STREAM_URING
+    int64_t res;  unsigned slot = state->complete(res);
+    State::Request &req = state->requests[slot];
+    bool retry = res == -EINTR || res == -EAGAIN;
+    if(res > 0 && uint64_t(res) < req.size)
+    {
+        req.offset += res;  req.data += res;  req.size -= res;  retry = true;
+    }
+    else if(!retry && res != int64_t(req.size))failed = true;
+
+    if(retry)
+    {
+        if(state->submit(file.fd, slot))return;
+        bool done = req.opcode == IORING_OP_WRITE ?
+            file.write(req.offset, req.data, req.size) : file.read(req.offset, req.data, req.size);
+        if(!done)failed = true;
+    }
+    state->free.push_back(slot);  in_flight--;
+#endif
+}
+
+bool FileQueue::submit(uint64_t offset, const void *data, size_t size, bool write)
+{
+    // requests too large for a single ring entry or not taken by the ring are done in place
+
+    range_start = std::min(range_start, offset);  range_end = std::max(range_end, offset + size);
+    written = written || write;
+#ifdef STREAM_URING
+    if(state && size <= max_request)
+    {
+        while(in_flight == depth)reap();
+        unsigned slot = state->free.back();
+        state->requests[slot] = {offset, static_cast<char *>(const_cast<void *>(data)), size,
+            uint8_t(write ? IORING_OP_WRITE : IORING_OP_READ)};
+        if(state->submit(file.fd, slot))
+        {
+            state->free.pop_back();  in_flight++;  return true;
+        }
+    }
+#endif
+    if(write ? file.write(offset, data, size) : file.read(offset, const_cast<void *>(data), size))return true;
+    failed = true;  return false;
+}
+
+bool FileQueue::wait()
+{
+    while(in_flight)reap();
+    if(range_start < range_end)file.release(range_start, range_end - range_start, written);
+    range_start = -1;  range_end = 0;  written = false;
+    bool res = !failed;  failed = false;  return res;
+}
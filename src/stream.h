@@ -3,10 +3,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <cstdio>
+#include <memory>
 #include <vector>
+#ifdef _WIN32
+#include <mutex>
+#endif
 #include "hash.h"
 
 
@@ -36,6 +41,7 @@ class OutStream
     Hash hash;
     std::vector<char> buf;
     size_t pos;
+    bool hashed;
 
 
     void put_overflow(const char *data, size_t size);
@@ -49,7 +55,7 @@ protected:
     }
 
 public:
-    explicit OutStream(size_t size = 1ul << 16) : buf(size), pos(0)
+    explicit OutStream(size_t size = 1ul << 16, bool hashed = true) : buf(size), pos(0), hashed(hashed)
     {
         assert(size / Hash::block_size * Hash::block_size == size);
     }
@@ -71,7 +77,7 @@ public:
 
     void assert_align(unsigned n)
     {
-        assert(!(pos & StreamAlign(n).mask));
+        assert(!(pos & StreamAlign(n).mask));  (void)n;
     }
 
     OutStream &operator << (const StreamAlign &align)
@@ -142,18 +148,30 @@ class InStream
 {
     Hash hash;
     std::vector<char> buf;
-    size_t pos, ready;
-    bool last;
+    const char *window;  // buf or memory of the source
+    size_t span, pos, ready;
+    bool last, hashed;
 
 
     bool load_buffer();
     bool get_underflow(char *data, size_t size);
 
 protected:
-    virtual size_t underflow(char *data, size_t size) = 0;
+    virtual size_t underflow(char *data, size_t size)
+    {
+        (void)data;
+        (void)size;
+        return 0;
+    }
+
+    virtual size_t underflow_span(const char *&data, size_t size)  // sources in memory return their own spans
+    {
+        data = buf.data();  return underflow(buf.data(), size);
+    }
 
 public:
-    explicit InStream(size_t size = 1ul << 16) : buf(size), pos(0), ready(0)
+    explicit InStream(size_t size = 1ul << 16, bool hashed = true, bool buffered = true) :
+        buf(buffered ? size : 0), window(buf.data()), span(size), pos(0), ready(0), hashed(hashed)
     {
         assert(size / Hash::block_size * Hash::block_size == size);
     }
@@ -165,17 +183,22 @@ public:
     bool initialize();
     bool finalize(const void *checksum);
 
+    bool at_end() const
+    {
+        return ready && pos == ready && last;
+    }
+
 
     bool get(void *data, size_t size)
     {
         if(size > ready - pos)return get_underflow(static_cast<char *>(data), size);
-        std::memcpy(data, buf.data() + pos, size);  pos += size;  return true;
+        std::memcpy(data, window + pos, size);  pos += size;  return true;
     }
 
 
     void assert_align(unsigned n)
     {
-        assert(!(pos & StreamAlign(n).mask));
+        assert(!(pos & StreamAlign(n).mask));  (void)n;
     }
 
     InStream &operator >> (const StreamAlign &align)
@@ -183,7 +206,7 @@ public:
         static const char zero[Hash::block_size] = {};
 
         unsigned tail = unsigned(-pos) & align.mask;
-        if(tail > ready - pos || std::memcmp(buf.data() + pos, zero, tail))
+        if(tail > ready - pos || std::memcmp(window + pos, zero, tail))
             pos = ready = 0;
         else 
             pos += tail;  
@@ -254,6 +277,42 @@ public:
 
 
 
+class OutBufferStream : public OutStream  // unhashed, for parallel serialization
+{
+protected:
+    void overflow(const char *data, size_t size, bool last) final
+    {
+        (void)last;  result.insert(result.end(), data, data + size);
+    }
+
+public:
+    std::vector<char> result;
+
+    explicit OutBufferStream(size_t size = 1ul << 12) : OutStream(size, false)
+    {
+    }
+};
+
+
+class InBufferStream : public InStream  // unhashed, for parallel parsing, decodes in place
+{
+    const char *data;
+    size_t left;
+
+protected:
+    size_t underflow_span(const char *&span, size_t size) final
+    {
+        size_t res = left, n = std::min(size, left);
+        span = data;  data += n;  left -= n;  return res;
+    }
+
+public:
+    InBufferStream(const char *data, size_t size) : InStream(size_t(1) << 30, false, false), data(data), left(size)
+    {
+    }
+};
+
+
 class OutFileStream : public OutStream
 {
     FILE *file;
@@ -302,3 +361,107 @@ public:
     bool open(const char *path);
     bool close();
 };
+
+
+class InMapStream : public InStream  // decodes directly from the file mapping
+{
+    const char *map;
+    size_t map_size, total_size, offs;
+    bool framed;
+#ifdef _WIN32
+    std::vector<char> content;
+#endif
+
+    void set_size();
+
+protected:
+    size_t underflow_span(const char *&data, size_t size) final;
+
+public:
+    static constexpr size_t frame_size = 1ul << 16;
+
+    // framed: layout of the old OutFileStream (Evol0004), every full frame is followed by a hash state
+    explicit InMapStream(bool framed = false) :
+        InStream(framed ? frame_size : 1ul << 22, true, false), map(nullptr), framed(framed)
+    {
+    }
+
+    ~InMapStream()
+    {
+        assert(!map);
+    }
+
+    bool open(const char *path);
+    bool close();
+};
+
+
+class ChunkFile  // positioned reads and writes, can be used from several threads at once
+{
+    friend class FileQueue;
+
+#ifdef _WIN32
+    FILE *file;
+    mutable std::mutex mutex;
+#else
+    int fd;
+#endif
+
+public:
+    ChunkFile();
+
+    ~ChunkFile()
+    {
+        assert(!is_open());
+    }
+
+    bool is_open() const;
+    bool open(const char *path);
+    bool create(const char *path);
+    bool size(uint64_t &res) const;
+    bool read(uint64_t offset, void *data, size_t size) const;
+    bool write(uint64_t offset, const void *data, size_t size) const;
+    void release(uint64_t offset, uint64_t size, bool written) const;  // drop from page cache, written data is flushed first
+    bool close();
+};
+
+
+class FileQueue  // positioned reads and writes of a ChunkFile in flight: io_uring if available, else done on submission
+{
+    // restart I/O is streamed once, so wait() drops the range done since the previous one from page cache,
+    // that keeps the simulation's memory resident (offsets and sizes of chunks are unaligned for O_DIRECT)
+
+    struct State;
+
+    const ChunkFile &file;
+    std::unique_ptr<State> state;
+    unsigned depth, in_flight;
+    uint64_t range_start, range_end;
+    bool written, failed;
+
+    bool submit(uint64_t offset, const void *data, size_t size, bool write);
+    void reap();
+
+public:
+    static constexpr size_t max_request = 1ul << 30;  // larger ones are not queued
+
+    FileQueue(const ChunkFile &file, unsigned depth);  // depth 0: plain reads and writes
+    ~FileQueue();
+
+    bool is_ring() const
+    {
+        return bool(state);
+    }
+
+    bool read(uint64_t offset, void *data, size_t size)
+    {
+        return submit(offset, data, size, false);
+    }
+
+    bool write(uint64_t offset, const void *data, size_t size)
+    {
+        return submit(offset, data, size, true);
+    }
+
+    bool wait();  // for all requests, false if any of them failed since the previous wait
+};
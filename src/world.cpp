@@ -69,7 +69,7 @@ bool Config::calc_derived()
     mask_x = (uint32_t(1) << order_x) - 1;
     mask_y = (uint32_t(1) << order_y) - 1;
     full_mask_x = (uint64_t(1) << (order_x + tile_order)) - 1;
-    full_mask_y = (uint64_t(1) << (order_x + tile_order)) - 1;;
+    full_mask_y = (uint64_t(1) << (order_y + tile_order)) - 1;
     base_r2 = uint64_t(base_radius) * base_radius;
     repression_r2 = uint64_t(repression_range) * repression_range;
 
@@ -187,7 +187,7 @@ bool Food::load(const Config &config, InStream &stream, uint64_t offs_x, uint64_
     uint32_t x, y;  stream >> x >> y;  if(!stream)return false;
 
     type = Type(x >> tile_order);
-    pos.x = x & (tile_mask | offs_x);  
+    pos.x = (x & tile_mask) | offs_x;
     pos.y = y | offs_y;
     return type > dead && type <= meat && !(y >> tile_order);
 }
@@ -260,7 +260,14 @@ struct GeneSequence
 
 Genome::Genome(const Config &config, Random &rand, const Genome &parent, const Genome *father)
 {
-    uint32_t chromosome_count = uint32_t(1) << config.chromosome_bits;
+    if(DefaultGeneBits::match(config))inherit(DefaultGeneBits(), config, rand, parent, father);
+    else inherit(GeneBits(config), config, rand, parent, father);
+}
+
+template<typename Bits> void Genome::inherit(const Bits &bits, const Config &config,
+    Random &rand, const Genome &parent, const Genome *father)
+{
+    uint32_t chromosome_count = uint32_t(1) << bits.chromosome_bits;
     assert(parent.chromosomes.size() == chromosome_count);
 
     // stage 1: clone or take one of every pair from parents
@@ -384,7 +391,7 @@ Genome::Genome(const Config &config, Random &rand, const Genome &parent, const G
 }
 
 
-bool Genome::load(const Config &config, InStream &stream)
+bool Genome::load(const Config &config, InStream &stream, bool legacy)
 {
     constexpr uint32_t max_genes = 1ul << 24;
 
@@ -392,7 +399,7 @@ bool Genome::load(const Config &config, InStream &stream)
     chromosomes.resize(uint32_t(1) << config.chromosome_bits);
     for(auto &chromosome : chromosomes)
     {
-        stream >> chromosome;
+        stream >> chromosome;  if(legacy)stream >> align(8);
         if(!stream || chromosome > max_genes - gene_count)return false;
         gene_count += chromosome;
     }
@@ -404,15 +411,9 @@ bool Genome::load(const Config &config, InStream &stream)
 void Genome::save(OutStream &stream) const
 {
     stream.assert_align(8);
-    for(auto &chromosome : chromosomes)
-    {
-        stream << chromosome;  
-        stream << align(8);
-    }
-    for(auto &gene : genes)
-    {
-        stream << gene.data;
-    }
+    for(auto &chromosome : chromosomes)stream << chromosome;
+    stream << align(8);
+    for(auto &gene : genes)stream << gene.data;
 }
 
 
@@ -496,13 +497,14 @@ void GenomeProcessor::State::create_slot(SlotData &slot, size_t link_pos)
     reset(link_pos);
 }
 
-void GenomeProcessor::State::process_gene(const Config &config, Genome::Gene &gene, std::vector<LinkData> &links)
+template<typename Bits> void GenomeProcessor::State::process_gene(const Bits &bits,
+    Genome::Gene &gene, std::vector<LinkData> &links)
 {
     uint32_t type = gene.take_bits(slot_type_bits);
     if(!type)
     {
-        uint32_t source = gene.take_bits(config.slot_bits);
-        int32_t weight = gene.take_bits_signed(config.base_bits);
+        uint32_t source = gene.take_bits(bits.slot_bits);
+        int32_t weight = gene.take_bits_signed(bits.base_bits);
         if(!weight)
             return;  
         
@@ -516,7 +518,7 @@ void GenomeProcessor::State::process_gene(const Config &config, Genome::Gene &ge
     type_or  |= type;
     type_and &= type;
 
-    base += gene.take_bits(config.base_bits);
+    base += gene.take_bits(bits.base_bits);
     angle_t angle1 = gene.take_bits(angle_bits);
     angle_t angle2 = gene.take_bits(angle_bits);
     radius += gene.take_bits(radius_bits);
@@ -537,9 +539,9 @@ void GenomeProcessor::State::process_gene(const Config &config, Genome::Gene &ge
 }
 
 
-void GenomeProcessor::update(const Config &config, const Genome &genome)
+template<typename Bits> void GenomeProcessor::update(const Bits &bits, const Genome &genome)
 {
-    uint32_t slot_count = uint32_t(1) << config.slot_bits;
+    uint32_t slot_count = uint32_t(1) << bits.slot_bits;
     slots.resize(slot_count);  links.clear();
 
     std::vector<Genome::Gene> genes = genome.genes;
@@ -549,9 +551,9 @@ void GenomeProcessor::update(const Config &config, const Genome &genome)
     State state;  size_t index = 0;
     for(Genome::Gene gene : genes)
     {
-        uint32_t slot = gene.take_bits(config.slot_bits);
+        uint32_t slot = gene.take_bits(bits.slot_bits);
         while(index < slot)state.create_slot(slots[index++], links.size());
-        state.process_gene(config, gene, links);
+        state.process_gene(bits, gene, links);
     }
     while(index < slot_count)state.create_slot(slots[index++], links.size());
 }
@@ -667,7 +669,9 @@ void GenomeProcessor::finalize()
 
 void GenomeProcessor::process(const Config &config, const Genome &genome)
 {
-    update(config, genome);  finalize();
+    if(DefaultGeneBits::match(config))update(DefaultGeneBits(), genome);
+    else update(GeneBits(config), genome);
+    finalize();
     passive_cost.initial  = config.base_cost.initial  + genome.genes.size() * config.gene_cost.initial;
     passive_cost.per_tick = config.base_cost.per_tick + genome.genes.size() * config.gene_cost.per_tick;
     max_energy = max_life = 0;  std::memset(count, 0, sizeof(count));
@@ -854,7 +858,7 @@ Creature::Creature(const Config &config, Genome &genome, const GenomeProcessor &
     rotators.reserve(update_counters(proc.count, offset, n, Slot::rotator));
     signals.reserve(update_counters(proc.count, offset, n, Slot::signal));
     update_counters(proc.count, offset, n, Slot::link);
-    order.reserve(n);  neirons.resize(n);
+    order.reserve(n);  std::vector<int32_t> act_level(n, 0);
 
     stomachs.reserve(update_counters(proc.count, offset, n, Slot::stomach));
     hides.reserve(update_counters(proc.count, offset, n, Slot::hide));
@@ -870,9 +874,9 @@ Creature::Creature(const Config &config, Genome &genome, const GenomeProcessor &
         uint32_t index = offset[append_slot(config, proc.slots[i])]++;
         mapping[i] = index;  slots[index] = i;
 
-        if(index < neirons.size())order.push_back(index);
+        if(index < act_level.size())order.push_back(index);
     }
-    assert(order.size() == neirons.size());
+    assert(order.size() == act_level.size());
 
     assert(wombs.size()    == proc.count[Slot::womb]);
     assert(claws.size()    == proc.count[Slot::claw]);
@@ -885,16 +889,16 @@ Creature::Creature(const Config &config, Genome &genome, const GenomeProcessor &
     assert(eyes.size()     == proc.count[Slot::eye]);
     assert(radars.size()   == proc.count[Slot::radar]);
 
-    links.reserve(proc.working_links);
-    for(size_t i = 0; i < neirons.size(); i++)
+    std::vector<Network::Link> links;  links.reserve(proc.working_links);
+    for(size_t i = 0; i < act_level.size(); i++)
     {
         const auto &slot = proc.slots[slots[i]];
         switch(slot.neiro_state)
         {
         case GenomeProcessor::s_input:       continue;
-        case GenomeProcessor::s_always_off:  neirons[i].act_level = +1;  continue;
-        case GenomeProcessor::s_always_on:   neirons[i].act_level = -1;  continue;
-        default:           /* s_normal */    neirons[i].act_level = slot.act_level;
+        case GenomeProcessor::s_always_off:  act_level[i] = +1;  continue;
+        case GenomeProcessor::s_always_on:   act_level[i] = -1;  continue;
+        default:           /* s_normal */    act_level[i] = slot.act_level;
         }
         uint32_t beg = slot.link_start, end = beg + slot.link_count;
         for(uint32_t j = beg; j < end; j++)
@@ -903,12 +907,13 @@ Creature::Creature(const Config &config, Genome &genome, const GenomeProcessor &
             switch(proc.slots[link.source].neiro_state)
             {
             case GenomeProcessor::s_always_off:  break;
-            case GenomeProcessor::s_always_on:  neirons[i].act_level -= 255 * link.weight;  break;
+            case GenomeProcessor::s_always_on:  act_level[i] -= 255 * link.weight;  break;
             default:  links.emplace_back(mapping[link.source], i, link.weight);
             }
         }
     }
     assert(links.size() == proc.working_links);
+    net.build(act_level, input.size(), links);
 }
 
 Creature *Creature::spawn(const Config &config, Genome &genome,
@@ -975,15 +980,15 @@ void Creature::process_food(const std::vector<Food> &foods)
     }
 }
 
-void Creature::eat_food(std::vector<Food> &foods) const
+void Creature::eat_food(Food *food, size_t n) const
 {
     assert(flags & f_eating);
-    for(auto &food : foods)if(food.type > Food::sprout)
+    for(size_t i = 0; i < n; i++)if(food[i].type > Food::sprout)
     {
-        int32_t dx = food.pos.x - pos.x;
-        int32_t dy = food.pos.y - pos.y;
+        int32_t dx = food[i].pos.x - pos.x;
+        int32_t dy = food[i].pos.y - pos.y;
         uint64_t r2 = int64_t(dx) * dx + int64_t(dy) * dy;
-        food.eater.update(r2, this);
+        food[i].eater.update(r2, this);
     }
 }
 
@@ -1004,7 +1009,7 @@ void Creature::process_detectors(const Creature *cr)
 
 void Creature::post_process(const Config &config)
 {
-    uint8_t *cur = input.data() + neirons.size();  uint64_t left = energy;
+    uint8_t *cur = input.data() + net.neiron_count;  uint64_t left = energy;
     for(const auto &stomach : stomachs)
     {
         uint64_t stock = std::min(left, stomach.capacity);
@@ -1028,12 +1033,7 @@ uint64_t Creature::execute_step(const Config &config)
     uint64_t total_energy = passive_cost.initial + energy;
     food_energy = 0;
 
-    for(auto &neiron : neirons)neiron.level = 0;
-    for(const auto &link : links)
-        neirons[link.output].level += link.weight * int16_t(input[link.input]);
-
-    for(size_t i = 0; i < neirons.size(); i++)
-        input[i] = neirons[i].level > neirons[i].act_level ? 255 : 0;
+    // network is evaluated beforehand by TileGroup::execute_networks()
 
     total_life = 0;
     for(size_t i = hides.size() - 1; i != size_t(-1); i--)
@@ -1078,10 +1078,10 @@ uint64_t Creature::execute_step(const Config &config)
 }
 
 
-Creature *Creature::load(const Config &config, InStream &stream, uint64_t next_id, uint64_t *buf)
+Creature *Creature::load(const Config &config, InStream &stream, uint64_t next_id, uint64_t *buf, bool legacy)
 {
     uint64_t id;  stream >> id;  Genome genome;
-    if(!stream || !genome.load(config, stream))return nullptr;
+    if(!stream || !genome.load(config, stream, legacy))return nullptr;
 
     uint32_t x, y;  angle_t angle;  uint64_t energy;
     stream >> x >> y >> angle >> align(8) >> energy;
@@ -1153,64 +1153,180 @@ void Creature::save(OutStream &stream, uint64_t *buf) const
 
 // TileLayout struct
 
-TileLayout::TileLayout(uint32_t size_x, uint32_t size_y, uint32_t group_count) :
-    size_x(size_x), size_y(size_y), tiles(size_x * size_y), groups(group_count)
+uint32_t spread_bits(uint32_t val)  // 16 bits to even positions
 {
-    for(size_t i = 0; i < tiles.size(); i++)
-    {
-        uint32_t group = uint64_t(i) * group_count / tiles.size();
+    val = (val | val << 8) & 0x00FF00FF;
+    val = (val | val << 4) & 0x0F0F0F0F;
+    val = (val | val << 2) & 0x33333333;
+    return (val | val << 1) & 0x55555555;
+}
 
-        tiles[i].group = group;
-        tiles[i].index = groups[group].tile_count++;
-        tiles[i].ref_count = 0;
-    }
+uint32_t compact_bits(uint32_t val)  // even positions to 16 bits
+{
+    val &= 0x55555555;
+    val = (val | val >> 1) & 0x33333333;
+    val = (val | val >> 2) & 0x0F0F0F0F;
+    val = (val | val >> 4) & 0x00FF00FF;
+    return (val | val >> 8) & 0x0000FFFF;
 }
 
-void TileLayout::process_tile(TileDesc &cur, const Offsets &offs_x, const Offsets &offs_y)
+void TileLayout::init(const Config &config, uint32_t group_count)
 {
-    uint32_t prev = -1, ref;
-    for(int i = 0; i < 3; i++)for(int j = 0; j < 3; j++)
+    order_x = config.order_x;  order_y = config.order_y;  order = order_x + order_y;
+    mask_x = config.mask_x;  mask_y = config.mask_y;
+    mask = (uint32_t(1) << order) - 1;  halo = 2 * mask_x + 1;
+    unit = std::min<uint32_t>(order, page_order);
+
+    TileLayout::group_count = group_count;  start.resize(group_count + 1);
+    for(uint32_t i = 0; i <= group_count; i++)
+        start[i] = ((uint64_t(i) << (order - unit)) + group_count - 1) / group_count << unit;
+
+    border.assign(group_count, std::vector<uint32_t>());
+    for(uint32_t i = 0; i < group_count; i++)
+        for(uint32_t page = start[i]; page < start[i + 1]; page += uint32_t(1) << unit)
+            if(!inner_page(page))border[i].push_back((page - start[i]) >> page_order);  // unit is smaller only for single page
+
+    outer.clear();
+    if(ordering == l_rows)return;
+
+    outer.resize(group_count);
+    for(uint32_t i = 0; i < group_count; i++)
     {
-        TileDesc &tile = tiles[offs_y.pos[i] + offs_x.pos[j]];
-        if(prev != tile.group)
+        for(uint32_t page : border[i])
         {
-            ref = groups[prev = tile.group].ref_count++;
-            cur.refs[cur.ref_count++] = {prev, ref};
+            page = start[i] + (page << page_order);
+            for(uint32_t pos = page; pos < std::min(page + (uint32_t(1) << page_order), start[i + 1]); pos++)
+            {
+                uint32_t near[9];  neighborhood(tile_index(pos), near);
+                for(uint32_t cur : near)if(group(cur) != i)outer[i].push_back(cur);
+            }
         }
-        tile.neighbors[4 + offs_y.offs[i] + offs_x.offs[j]] = ref;
+        std::sort(outer[i].begin(), outer[i].end());
+        outer[i].erase(std::unique(outer[i].begin(), outer[i].end()), outer[i].end());
     }
 }
 
-void TileLayout::process_line(uint32_t pos, const Offsets &offs_y)
+uint32_t TileLayout::position(uint32_t index) const
+{
+    if(ordering == l_rows)return index;
+
+    uint32_t x = index & mask_x, y = index >> order_x;
+    uint32_t n = std::min(order_x, order_y), low = (uint32_t(1) << n) - 1;
+    return spread_bits(x & low) | spread_bits(y & low) << 1 | ((x >> n) | (y >> n)) << 2 * n;
+}
+
+uint32_t TileLayout::tile_index(uint32_t pos) const
+{
+    if(ordering == l_rows)return pos;
+
+    uint32_t n = std::min(order_x, order_y), low = (uint32_t(1) << 2 * n) - 1;
+    uint32_t x = compact_bits(pos & low), y = compact_bits((pos & low) >> 1);
+    if(order_x > order_y)x |= (pos >> 2 * n) << n;  else y |= (pos >> 2 * n) << n;
+    return x | y << order_x;
+}
+
+uint32_t TileLayout::buffer_count(uint32_t group) const
+{
+    uint32_t count = start[group + 1] - start[group];
+    if(ordering == l_rows)return std::min<uint64_t>(size(), count + 2 * halo);
+    return count + outer[group].size();
+}
+
+uint32_t TileLayout::buffer_index(uint32_t group, uint32_t index) const
 {
-    uint32_t n = size_x - 1;
-    process_tile(tiles[pos], Offsets(0, 0, 1, -1, n, 1), offs_y);
-    for(uint32_t x = 1; x < n; x++)
-        process_tile(tiles[pos + x], Offsets(x - 1, 1, x, 0, x + 1, -1), offs_y);
-    process_tile(tiles[pos + n], Offsets(0, -1, n - 1, 1, n, 0), offs_y);
+    if(ordering == l_rows)return (index - start[group] + halo) & mask;
+
+    uint32_t pos = position(index) - start[group], count = start[group + 1] - start[group];
+    if(pos < count)return pos;
+
+    const auto &list = outer[group];
+    auto ptr = std::lower_bound(list.begin(), list.end(), index);
+    assert(ptr != list.end() && *ptr == index);
+    return count + (ptr - list.begin());
 }
 
-void TileLayout::build_layout()
+void TileLayout::neighborhood(uint32_t index, uint32_t *res) const
 {
-    uint32_t n = size_x * (size_y - 1);
-    process_line(0, Offsets(0, 0, size_x, -3, n, 3));
-    for(uint32_t pos = size_x; pos < n; pos += size_x)
-        process_line(pos, Offsets(pos - size_x, 3, pos, 0, pos + size_x, -3));
-    process_line(n, Offsets(0, -3, n - size_x, 3, n, 0));
+    uint32_t x = index & mask_x, y = index >> order_x;
+    uint32_t x1 = (x + 1) & mask_x, xm = (x - 1) & mask_x;
+    uint32_t y1 = (y + 1) & mask_y, ym = (y - 1) & mask_y;
+
+    res[0] = xm | (ym << order_x);  res[1] = x | (ym << order_x);  res[2] = x1 | (ym << order_x);
+    res[3] = xm | (y  << order_x);  res[4] = x | (y  << order_x);  res[5] = x1 | (y  << order_x);
+    res[6] = xm | (y1 << order_x);  res[7] = x | (y1 << order_x);  res[8] = x1 | (y1 << order_x);
+}
+
+bool TileLayout::inner(uint32_t index) const
+{
+    if(group_count == 1)return true;
+
+    uint32_t pos = position(index), own = group_at(pos);
+    if(ordering == l_rows)return pos - start[own] >= halo && start[own + 1] - pos > halo;
+
+    // smallest aligned block with whole neighborhood, its positions are contiguous
+    uint32_t x = index & mask_x, y = index >> order_x;
+    if(!x || x == mask_x || !y || y == mask_y)return false;
+    uint32_t n = std::max(ilog2((x - 1) ^ (x + 1)), ilog2((y - 1) ^ (y + 1))) + 1;
+    if(n > std::min(order_x, order_y))return false;
+
+    uint32_t first = pos >> 2 * n << 2 * n;
+    return first >= start[own] && first + (uint32_t(1) << 2 * n) <= start[own + 1];
+}
+
+bool TileLayout::inner_page(uint32_t pos) const
+{
+    if(group_count == 1)return true;
+
+    // in row-major order inner() only depends on distances to group bounds
+    uint32_t last = pos + (uint32_t(1) << unit) - 1;
+    if(ordering == l_rows)return inner(pos) && inner(last);
+
+    // Morton page is 8x8 square, blocks checked for its corners cover its neighborhood
+    if(std::min(order_x, order_y) < 3)
+    {
+        for(uint32_t cur = pos; cur <= last; cur++)if(!inner(tile_index(cur)))return false;
+        return true;
+    }
+    uint32_t index = tile_index(pos), dx = 7, dy = 7 << order_x;
+    return inner(index) && inner(index + dx) && inner(index + dy) && inner(index + dx + dy);
+}
+
+int TileLayout::buffer_refs(uint32_t index, Reference *res) const
+{
+    // sorted by group: incoming objects are in curve order regardless of group count
+
+    if(inner(index))  // common case: all neighbors in one group
+    {
+        uint32_t own = group(index);
+        res[0] = {own, buffer_index(own, index)};  return 1;
+    }
+
+    uint32_t near[9];  neighborhood(index, near);
+    for(uint32_t &cur : near)cur = group(cur);
+    std::sort(near, near + 9);
+
+    int n = std::unique(near, near + 9) - near;
+    for(int i = 0; i < n; i++)res[i] = {near[i], buffer_index(near[i], index)};
+    return n;
 }
 
 
 
 // TileGroup struct
 
-void TileGroup::alloc(const TileLayout::GroupDesc &desc)
+const TileGroup::Tile TileGroup::empty_tile;
+
+void TileGroup::alloc(const TileLayout &layout, uint32_t index)
 {
-    tiles.resize(desc.tile_count);  buffers.resize(desc.ref_count);
+    TileGroup::layout = &layout;  id = index;
+    start = layout.start[index];  tile_count = layout.start[index + 1] - start;
+    tiles.reset(tile_count);
+    buffers.reset(layout.buffer_count(index));  eaters.reset(buffers.size);
+    step_count = 0;
 }
 
-TileGroup::Tile::Tile()
+TileGroup::Tile::Tile() : spawn_start(0), children_count(0), children(nullptr), del_queue(nullptr)
 {
-    first = nullptr;  last = &first;
 }
 
 TileGroup::Tile::~Tile()
@@ -1221,59 +1337,103 @@ TileGroup::Tile::~Tile()
     }
 }
 
-void TileGroup::Tile::init(const TileLayout::TileDesc &desc)
+void TileGroup::Tile::take(Tile &tile)  // between steps only
 {
-    std::memcpy(neighbors, desc.neighbors, sizeof(neighbors));
-    for(int i = 0; i < desc.ref_count; i++)refs[i] = desc.refs[i];
-    ref_count = desc.ref_count;
+    assert(!first && !tile.children && !tile.del_queue);
+    foods.swap(tile.foods);
+    if(tile.first)
+    {
+        first = tile.first;  last = tile.last;
+    }
+    tile.first = nullptr;  tile.last = &tile.first;
+
+    food_count = tile.food_count;
+    creature_count = tile.creature_count;
+    attack_count = tile.attack_count;
+    spawn_start = tile.spawn_start;
 }
 
 
-uint32_t TileGroup::neighbor_index(const Config &config, const Tile &tile, Position &pos)
+bool TileGroup::buffers_idle(uint32_t page) const
+{
+    if(layout->ordering != TileLayout::l_rows)return !buffers.page(page);  // own tiles are the first buffers
+
+    uint32_t pos = start + (page << page_order), last = std::min(pos + tiles.page_size, start + tile_count) - 1;
+    uint32_t first = buffer_index(layout->tile_index(pos)), end = buffer_index(layout->tile_index(last));
+    if(first > end)return false;  // wraps around
+
+    for(uint32_t k = first >> page_order; k <= end >> page_order; k++)if(buffers.page(k))return false;
+    return true;
+}
+
+uint32_t TileGroup::neighbor_index(const Config &config, Position &pos) const
 {
     pos.x &= config.full_mask_x;
     pos.y &= config.full_mask_y;
-    uint32_t dx = (uint32_t(pos.x >> tile_order) - tile.x + 1) & config.mask_x;
-    uint32_t dy = (uint32_t(pos.y >> tile_order) - tile.y + 1) & config.mask_y;
-    assert(dx < 3 && dy < 3);
+    uint32_t x = pos.x >> tile_order, y = pos.y >> tile_order;
+    return buffer_index(x | (y << config.order_x));
+}
+
+// Random state of a tile exists only during its execute_step(): it's derived from seed, time and tile index,
+// so empty tiles keep nothing.  Random sprouts are rare events found in advance by geometric gaps
+// over blocks of positions, every block with its own random state as well.
 
-    return tile.neighbors[dx + 3 * dy];
+Random tile_random(uint64_t seed, uint64_t time, uint64_t seq)
+{
+    return Random(seed + time * 0x9E3779B97F4A7C15ull, seq);
 }
 
-void TileGroup::spawn_grass(const Config &config, Tile &tile)  // TODO: tile relative position
+void TileGroup::find_sprouts(const Context &context, uint64_t time)
 {
-    uint64_t offs_x = uint64_t(tile.x) << tile_order;
-    uint64_t offs_y = uint64_t(tile.y) << tile_order;
-    uint32_t n = tile.rand.poisson(config.exp_sprout_per_tile);
-    for(uint32_t k = 0; k < n; k++)
+    sprouts.clear();
+    uint32_t exp_prob = context.config.exp_sprout_per_tile;
+    if(exp_prob == uint32_t(-1))return;  // never
+
+    uint64_t end = uint64_t(start) + tile_count;
+    for(uint64_t block = start >> sprout_block_order; block << sprout_block_order < end; block++)
     {
-        uint64_t xx = (tile.rand.uint32() & tile_mask) | offs_x;
-        uint64_t yy = (tile.rand.uint32() & tile_mask) | offs_y;
-        buffers[tile.neighbors[4]].foods.emplace_back(config, Food::sprout, Position{xx, yy});
+        Random rand = tile_random(context.seed, time, (uint64_t(1) << 32) + block);
+        uint64_t pos = block << sprout_block_order, last = std::min(end, pos + (uint64_t(1) << sprout_block_order));
+        for(pos += rand.geometric(exp_prob + 1); pos < last; pos += uint64_t(rand.geometric(exp_prob + 1)) + 1)
+            if(pos >= start)sprouts.push_back(pos - start);
     }
-    for(size_t i = 0; i < tile.foods.size(); i++)
+}
+
+void TileGroup::spawn_grass(const Config &config, uint32_t index, Tile *tile, Random &rand, uint32_t sprouts)  // TODO: tile relative position
+{
+    uint64_t offs_x = uint64_t(index & config.mask_x) << tile_order;
+    uint64_t offs_y = uint64_t(index >> config.order_x) << tile_order;
+    auto &own = food_buffer(buffer_index(index), index, tile).foods;
+    for(uint32_t k = 0; k < sprouts; k++)
+    {
+        uint64_t xx = (rand.uint32() & tile_mask) | offs_x;
+        uint64_t yy = (rand.uint32() & tile_mask) | offs_y;
+        own.emplace_back(config, Food::sprout, Position{xx, yy});
+    }
+    if(!tile)return;
+
+    for(size_t i = 0; i < tile->spawn_start; i++)  // sprouts are appended after spawn_start
     {
-        if(tile.foods[i].type != Food::grass)continue;
-        uint32_t n = tile.rand.poisson(config.exp_sprout_per_grass);
+        if(tile->foods[i].type != Food::grass)continue;
+        uint32_t n = rand.poisson(config.exp_sprout_per_grass);
         for(uint32_t k = 0; k < n; k++)
         {
-            Position pos = tile.foods[i].pos;
-            angle_t angle = tile.rand.uint32();
+            Position pos = tile->foods[i].pos;
+            angle_t angle = rand.uint32();
             pos.x += r_sin(config.sprout_dist_x4, angle + angle_90);
             pos.y += r_sin(config.sprout_dist_x4, angle);
 
-            uint32_t index = neighbor_index(config, tile, pos);
-            buffers[index].foods.emplace_back(config, Food::sprout, pos);
+            food_buffer(neighbor_index(config, pos), index, tile).foods.emplace_back(config, Food::sprout, pos);
         }
     }
 }
 
-void TileGroup::spawn_meat(const Config &config, Tile &tile, Position pos, uint64_t energy)
+void TileGroup::spawn_meat(const Config &config, uint32_t index, Tile *tile, Random &rand, Position pos, uint64_t energy)
 {
     if(energy < config.food_energy)return;
     for(energy -= config.food_energy;;)
     {
-        auto &buf = buffers[neighbor_index(config, tile, pos)];
+        auto &buf = food_buffer(neighbor_index(config, pos), index, tile);
         buf.foods.emplace_back(config, Food::meat, pos);  buf.food_count++;
         
         if(energy < config.food_energy)
@@ -1281,160 +1441,419 @@ void TileGroup::spawn_meat(const Config &config, Tile &tile, Position pos, uint6
         
         energy -= config.food_energy;
 
-        angle_t angle = tile.rand.uint32();
+        angle_t angle = rand.uint32();
         pos.x += r_sin(config.meat_dist_x4, angle + angle_90);
         pos.y += r_sin(config.meat_dist_x4, angle);
     }
 }
 
-void TileGroup::execute_step(const Config &config)
+void TileGroup::execute_batches(std::vector<std::pair<uint64_t, Creature *>> &queue, std::vector<uint8_t *> &batch)
+{
+    std::sort(queue.begin(), queue.end(),
+        [](const std::pair<uint64_t, Creature *> &a, const std::pair<uint64_t, Creature *> &b)
+        {
+            return a.first < b.first;
+        });
+
+    for(size_t i = 0, j; i < queue.size(); i = j)
+    {
+        Creature *cr = queue[i].second;  batch.clear();
+        for(j = i + 1; j < queue.size() && queue[j].first == queue[i].first; j++)
+        {
+            Creature *other = queue[j].second;
+            if(other->net == cr->net)
+            {
+                other->net_state.valid = false;  batch.push_back(other->input.data());
+            }
+            else other->net.execute(other->net_state, other->input.data());
+        }
+        if(batch.empty())
+        {
+            cr->net.execute(cr->net_state, cr->input.data());  continue;
+        }
+        cr->net_state.valid = false;  batch.push_back(cr->input.data());
+        cr->net.execute_batch(batch.data(), batch.size());  // bypasses net_state
+    }
+}
+
+void TileGroup::execute_networks(const Tile &tile)
+{
+    if(!Network::batching())
+    {
+        for(Creature *cr = tile.first; cr; cr = cr->next)cr->net.execute(cr->net_state, cr->input.data());
+        return;
+    }
+
+    net_queue.clear();
+    for(Creature *cr = tile.first; cr; cr = cr->next)net_queue.emplace_back(cr->net.identity, cr);
+    execute_batches(net_queue, net_batch);
+}
+
+void TileGroup::collect_food(const Config &config, uint32_t index, std::vector<TileGroup> &groups) const
+{
+    Reference refs[9];  int ref_count = layout->buffer_refs(index, refs);
+    for(int i = 0; i < ref_count; i++)
+    {
+        auto *eaters = groups[refs[i].group].eaters.find(refs[i].index);
+        if(!eaters)continue;
+
+        for(const Creature *cr : *eaters)cr->food_energy += config.food_energy;
+        eaters->clear();
+    }
+}
+
+void TileGroup::split_step(const Context &context, const Tile &tile)
+{
+    // networks and creature updates in parallel, everything that depends on order is left to the owner
+
+    split_list.clear();
+    for(Creature *cr = tile.first; cr; cr = cr->next)split_list.push_back(cr);
+    split_results.resize(split_list.size());
+
+    const Config &config = context.config;
+    std::function<void(size_t)> proc = [&](size_t chunk)
+    {
+        size_t begin = chunk * split_chunk, end = std::min(begin + split_chunk, split_list.size());
+        if(Network::batching())
+        {
+            std::vector<std::pair<uint64_t, Creature *>> queue;  std::vector<uint8_t *> batch;
+            for(size_t k = begin; k < end; k++)queue.emplace_back(split_list[k]->net.identity, split_list[k]);
+            execute_batches(queue, batch);
+        }
+        else for(size_t k = begin; k < end; k++)
+        {
+            Creature *cr = split_list[k];  cr->net.execute(cr->net_state, cr->input.data());
+        }
+
+        for(size_t k = begin; k < end; k++)
+        {
+            Creature *cr = split_list[k];  StepResult &res = split_results[k];
+            res.pos = cr->pos;  res.angle = cr->angle;
+            res.dead_energy = cr->execute_step(config);
+        }
+    };
+    context.run_split(id, (split_list.size() + split_chunk - 1) / split_chunk, proc);
+}
+
+void TileGroup::execute_step(Context &context, uint32_t index, uint64_t time, bool sprout)
 {
-    for(auto &buf : buffers)
+    const Config &config = context.config;
+    std::vector<TileGroup> &groups = context.groups;
+
+    Random rand = tile_random(context.seed, time, index);
+    uint32_t sprouts = sprout ? rand.poisson_nonzero(config.exp_sprout_per_tile) : 0;
+    Tile *ptr = tiles.find(local(index));
+    if(!ptr || !ptr->active())  // inactive tile: random sprouts only
     {
-        buf.foods.clear();  buf.last = &buf.first;
-        buf.food_count = buf.creature_count = buf.attack_count = 0;
+        if(sprouts)spawn_grass(config, index, nullptr, rand, sprouts);
+        if(ptr)ptr->spawn_start = ptr->food_count = ptr->children_count = 0;
+        return;
     }
+    Tile &tile = *ptr;
 
-    Creature **del_last = &del_queue;
-    for(auto &tile : tiles)
+    collect_food(config, index, groups);
+
+    auto &foods = tile.foods;  size_t n = 0;
+    for(size_t i = 0; i < foods.size(); i++)
+        if(!foods[i].eater.target && foods[i].type)foods[n++].set(config, foods[i]);
+    foods.resize(tile.spawn_start = tile.food_count = n);
+    spawn_grass(config, index, &tile, rand, sprouts);
+
+    bool split = context.group_count > 1 && tile.creature_count >= split_min_creatures;
+    if(split)split_step(context, tile);
+    else execute_networks(tile);
+
+    // creatures that stay in the tile are kept in place, only boundary crossings go through buffers
+
+    uint64_t id = 0;  // relative to tile, fixed in consolidate()
+    Creature **del_last = &tile.del_queue, **child_last = &tile.children;
+    Creature *next = tile.first;  tile.last = &tile.first;
+    tile.creature_count = tile.attack_count = 0;
+    uint32_t own = buffer_index(index);
+    for(size_t k = 0; next; k++)
     {
-        auto &foods = tile.foods;  size_t n = 0;
-        for(size_t i = 0; i < foods.size(); i++)
-            if(!foods[i].eater.target && foods[i].type)foods[n++].set(config, foods[i]);
-        foods.resize(tile.spawn_start = tile.food_count = n);
-        spawn_grass(config, tile);
+        Creature *cr = next;  next = next->next;
 
-        uint64_t id = next_id;
-        Creature *ptr = tile.first;  tile.last = &tile.first;
-        tile.creature_count = tile.attack_count = 0;
-        while(ptr)
+        Position prev_pos = cr->pos;
+        angle_t prev_angle = cr->angle;
+        uint64_t dead_energy;
+        if(split)
         {
-            Creature *cr = ptr;  ptr = ptr->next;
+            const StepResult &res = split_results[k];
+            prev_pos = res.pos;  prev_angle = res.angle;  dead_energy = res.dead_energy;
+        }
+        else dead_energy = cr->execute_step(config);
+        if(dead_energy)
+        {
+            *del_last = cr;  del_last = &cr->next;  // potential father
+            spawn_meat(config, index, &tile, rand, prev_pos, dead_energy);  continue;
+        }
 
-            Position prev_pos = cr->pos;
-            angle_t prev_angle = cr->angle;
-            uint64_t dead_energy = cr->execute_step(config);
-            if(dead_energy)
-            {
-                *del_last = cr;  del_last = &cr->next;  // potential father
-                spawn_meat(config, tile, prev_pos, dead_energy);  continue;
-            }
+        uint32_t dst = neighbor_index(config, cr->pos);
+        if(dst == own)tile.append(cr);
+        else buffers[dst].append(cr);
 
-            buffers[neighbor_index(config, tile, cr->pos)].append(cr);
-            for(const auto &womb : cr->wombs)if(womb.active)
+        for(const auto &womb : cr->wombs)if(womb.active)
+        {
+            Creature *child = Creature::spawn(config, rand, *cr,
+                id++, prev_pos, prev_angle ^ flip_angle, womb.energy);
+            uint64_t leftover = womb.energy;
+            if(child)
             {
-                Creature *child = Creature::spawn(config, tile.rand, *cr,
-                    id++, prev_pos, prev_angle ^ flip_angle, womb.energy);
-                uint64_t leftover = womb.energy;
-                if(child)
-                {
-                    leftover -= child->passive_cost.initial + child->energy;
-                    tile.append(child);
-                }
-                spawn_meat(config, tile, prev_pos, leftover);
+                leftover -= child->passive_cost.initial + child->energy;
+                *child_last = child;  child_last = &child->next;
+                tile.creature_count++;  tile.attack_count += child->attack_count;
             }
+            spawn_meat(config, index, &tile, rand, prev_pos, leftover);
         }
-        tile.children_count = id - next_id;  *tile.last = nullptr;
     }
-    *del_last = nullptr;
+    tile.children_count = id;  *tile.last = nullptr;  *child_last = nullptr;  *del_last = nullptr;
 }
 
-void TileGroup::consolidate(const std::vector<Reference> &layout, std::vector<TileGroup> &groups)
+void TileGroup::consolidate(uint32_t index, uint64_t id_offset, std::vector<TileGroup> &groups)
 {
-    uint64_t n = 0;
-    for(const auto &ref : layout)
+    Reference refs[9];  int ref_count = layout->buffer_refs(index, refs);
+    TileBuffer *bufs[9];  bool incoming = false;
+    for(int i = 0; i < ref_count; i++)
     {
-        if(groups.data() + ref.group == this)tiles[ref.index].id_offset = n;
-        n += groups[ref.group].tiles[ref.index].children_count;
+        bufs[i] = groups[refs[i].group].buffers.find(refs[i].index);
+        if(bufs[i] && (bufs[i]->creature_count || !bufs[i]->foods.empty()))incoming = true;
     }
-    next_id += n;
 
-    for(Creature *ptr = del_queue; ptr;)
+    Tile *ptr = tiles.find(local(index));
+    if(ptr ? !ptr->first && !ptr->children && !ptr->del_queue && ptr->foods.empty() && !incoming : !incoming)
+        return;  // stays inactive
+    Tile &tile = ptr ? *ptr : tiles[local(index)];
+
+    for(Creature *next = tile.del_queue; next;)
     {
-        Creature *cr = ptr;  ptr = ptr->next;  delete cr;
+        Creature *cr = next;  next = next->next;  delete cr;
     }
+    tile.del_queue = nullptr;
+
+    size_t n = tile.foods.size();
+    for(int i = 0; i < ref_count; i++)if(bufs[i])n += bufs[i]->foods.size();
+    tile.foods.reserve(n);
 
-    for(auto &tile : tiles)
+    Creature **last_child = &tile.children;
+    for(Creature *cr = tile.children; cr; cr = cr->next)
     {
-        size_t n = tile.foods.size();
-        for(int i = 0; i < tile.ref_count; i++)
-        {
-            const auto &ref = tile.refs[i];
-            n += groups[ref.group].buffers[ref.index].foods.size();
-        }
-        tile.foods.reserve(n);
+        cr->id += id_offset;  last_child = &cr->next;
+    }
 
-        Creature *first_child = tile.first, **last_child = tile.last;
-        for(Creature *cr = first_child; cr; cr = cr->next)cr->id += tile.id_offset;
+    for(int i = 0; i < ref_count; i++)if(bufs[i])
+    {
+        auto &buf = *bufs[i];
+        tile.foods.insert(tile.foods.end(), buf.foods.begin(), buf.foods.end());
+        tile.food_count += buf.food_count;
 
-        tile.last = &tile.first;
-        for(int i = 0; i < tile.ref_count; i++)
+        if(buf.creature_count)
         {
-            const auto &ref = tile.refs[i];
-            auto &buf = groups[ref.group].buffers[ref.index];
-
-            tile.foods.insert(tile.foods.end(), buf.foods.begin(), buf.foods.end());
-            tile.food_count += buf.food_count;
-
-            if(!buf.creature_count)continue;
             *tile.last = buf.first;  tile.last = buf.last;
             tile.creature_count += buf.creature_count;
             tile.attack_count += buf.attack_count;
         }
-        if(first_child)
-        {
-            *tile.last = first_child;  tile.last = last_child;
-        }
-        *tile.last = nullptr;
+        buf.clear();
     }
+    if(tile.children)
+    {
+        *tile.last = tile.children;  tile.last = last_child;  tile.children = nullptr;
+    }
+    *tile.last = nullptr;
 }
 
+// detectors only take minimums, sums or counts, so tiles and creatures can be processed in any order
 
-void TileGroup::Tile::process_detectors(const Config &config,
-    const std::vector<TileGroup> &groups, const Reference &ref)
+void TileGroup::Tile::process_creature(Creature *cr, const Tile &tile)
 {
-    const Tile &tile = groups[ref.group].tiles[ref.index];
-
-    for(Creature *cr = first; cr; cr = cr->next)
-    {
-        cr->process_food(tile.foods);
-        for(const Creature *tg = tile.first; tg; tg = tg->next)
-            if(tg != cr)cr->process_detectors(tg);
-    }
+    cr->process_food(tile.foods);
+    for(const Creature *tg = tile.first; tg; tg = tg->next)
+        if(tg != cr)cr->process_detectors(tg);
+}
 
+void TileGroup::Tile::process_foods(const Config &config, const Tile &tile, size_t begin, size_t end)
+{
     for(const Creature *tg = tile.first; tg; tg = tg->next)
-        if(tg->flags & Creature::f_eating)tg->eat_food(foods);
+        if(tg->flags & Creature::f_eating)tg->eat_food(foods.data() + begin, end - begin);
 
-    for(size_t i = spawn_start; i < foods.size(); i++)if(foods[i].type == Food::sprout)
+    for(size_t i = std::max<size_t>(begin, spawn_start); i < end; i++)if(foods[i].type == Food::sprout)
         foods[i].check_grass(config, tile.foods.data(), tile.spawn_start);
 }
 
-void TileGroup::process_detectors(const Config &config,
-    const std::vector<Reference> &layout, const std::vector<TileGroup> &groups)
+void TileGroup::Tile::process_detectors(const Config &config, const Tile &tile)
+{
+    for(Creature *cr = first; cr; cr = cr->next)process_creature(cr, tile);
+    process_foods(config, tile, 0, foods.size());
+}
+
+void TileGroup::process_detectors(const Config &config, const std::vector<TileGroup> &groups, uint32_t index, const Context *context)
 {
-    for(auto &tile : tiles)
+    Tile *ptr = tiles.find(local(index));
+    if(!ptr || !ptr->active())return;
+    Tile &tile = *ptr;
+
+    uint32_t near[9];  layout->neighborhood(index, near);
+    const Tile *others[9];  int count = 0;  uint64_t objects = 0;
+    for(uint32_t i : near)
+    {
+        Reference ref = layout->tile(i);
+        if(const Tile *other = groups[ref.group].tiles.find(ref.index))
+        {
+            others[count++] = other;  objects += other->creature_count + other->foods.size();
+        }
+    }
+
+    if(context && context->group_count > 1 && tile.creature_count * objects >= split_min_pairs)
     {
-        uint32_t x = tile.x, y = tile.y;
-        uint32_t x1 = (x + 1) & config.mask_x, xm = (x - 1) & config.mask_x;
-        uint32_t y1 = (y + 1) & config.mask_y, ym = (y - 1) & config.mask_y;
+        // creature chunks write only their own creatures, food chunks only their own foods
 
+        split_list.clear();
+        for(Creature *cr = tile.first; cr; cr = cr->next)split_list.push_back(cr);
+        std::function<void(size_t)> proc = [&](size_t chunk)
+        {
+            size_t end = std::min<size_t>((chunk + 1) * split_chunk, split_list.size());
+            for(size_t k = chunk * split_chunk; k < end; k++)
+            {
+                Creature *cr = split_list[k];  cr->pre_process(config);
+                for(int j = 0; j < count; j++)Tile::process_creature(cr, *others[j]);
+                cr->post_process(config);
+            }
+        };
+        context->run_split(id, (split_list.size() + split_chunk - 1) / split_chunk, proc);
+
+        proc = [&](size_t chunk)
+        {
+            size_t begin = chunk * split_chunk, end = std::min<size_t>(begin + split_chunk, tile.foods.size());
+            for(int j = 0; j < count; j++)tile.process_foods(config, *others[j], begin, end);
+        };
+        context->run_split(id, (tile.foods.size() + split_chunk - 1) / split_chunk, proc);
+    }
+    else
+    {
         for(Creature *cr = tile.first; cr; cr = cr->next)cr->pre_process(config);
-        tile.process_detectors(config, groups, layout[xm | (ym << config.order_x)]);
-        tile.process_detectors(config, groups, layout[x  | (ym << config.order_x)]);
-        tile.process_detectors(config, groups, layout[x1 | (ym << config.order_x)]);
-        tile.process_detectors(config, groups, layout[xm | (y  << config.order_x)]);
-        tile.process_detectors(config, groups, layout[x  | (y  << config.order_x)]);
-        tile.process_detectors(config, groups, layout[x1 | (y  << config.order_x)]);
-        tile.process_detectors(config, groups, layout[xm | (y1 << config.order_x)]);
-        tile.process_detectors(config, groups, layout[x  | (y1 << config.order_x)]);
-        tile.process_detectors(config, groups, layout[x1 | (y1 << config.order_x)]);
+        for(int j = 0; j < count; j++)tile.process_detectors(config, *others[j]);
         for(Creature *cr = tile.first; cr; cr = cr->next)cr->post_process(config);
+    }
 
-        for(auto &food : tile.foods)if(food.eater.target)
-            food.eater.target->food_energy += config.food_energy;
+    for(auto &food : tile.foods)if(food.eater.target)  // collected by owner in execute_step()
+    {
+        Position pos = food.eater.target->pos;
+        eaters[neighbor_index(config, pos)].push_back(food.eater.target);
     }
 }
 
+void TileGroup::process_detectors(const Config &config, const std::vector<TileGroup> &groups)
+{
+    for(uint32_t page = 0; page < tiles.page_count(); page++)if(tiles.page(page))
+    {
+        uint32_t end = std::min((page + 1) << page_order, tile_count);
+        for(uint32_t k = page << page_order; k < end; k++)process_detectors(config, groups, layout->tile_index(start + k), nullptr);
+    }
+}
+
+
+// Every phase of a tile depends only on the previous phase of its 3x3 neighborhood,
+// so there are no global barriers: tiles proceed as soon as their neighbors are ready.
+// The only wider dependencies are children ids (two-level prefix: tile sums inside the group
+// and group totals, only waited for once a tile with children is reached)
+// and the ring of children counts (execute_step() waits for consolidate() 2 steps back).
+// Every group processes its own tiles in order, so the result is deterministic.
+// Pages without allocated tiles are skipped: their tiles can only get random sprouts (into own buffers)
+// and, in consolidate(), objects from buffers, which are also own ones for pages away from group bounds.
+
+void TileGroup::step(Context &context, uint32_t index, uint64_t time)
+{
+    const Config &config = context.config;
+    uint32_t group_count = context.groups.size(), phase = 3 * step_count;
+    Context::GroupSync *sync = context.group_sync.get();  uint32_t slot = step_count & 3;
+    const uint32_t ring_phase = phase - 4;  // consolidate() of step - 2
+    auto publish = [sync, index](uint32_t phase, uint32_t done)
+    {
+        sync[index].progress.store(uint64_t(phase) << 32 | done, std::memory_order_release);
+    };
+
+    for(uint32_t i = 0; i < group_count; i++)context.wait_group(i, ring_phase);
+    find_sprouts(context, time);
+    uint64_t total = 0;  size_t next = 0;
+    for(uint32_t page = 0; page < tiles.page_count(); page++)
+    {
+        uint32_t begin = page << page_order, end = std::min(begin + tiles.page_size, tile_count);
+        if(!tiles.page(page))
+        {
+            for(; next < sprouts.size() && sprouts[next] < end; next++)
+                execute_step(context, layout->tile_index(start + sprouts[next]), time, true);
+            continue;
+        }
+        publish(phase + 1, begin);
+        for(uint32_t k = begin; k < end; k++)
+        {
+            bool sprout = next < sprouts.size() && sprouts[next] == k;  if(sprout)next++;
+            uint32_t i = layout->tile_index(start + k);
+            context.wait_neighbors(i, phase);
+            execute_step(context, i, time, sprout);
+            total += tiles.find(k)->children_count;
+            publish(phase + 1, k + 1);
+        }
+    }
+    sync[index].children_count[slot] = total;
+    publish(phase + 1, tile_count);
+
+    uint64_t id = next_id;  uint32_t prefix = 0;
+    food_count = creature_count = attack_count = 0;
+    const auto &border = layout->border[index];  next = 0;
+    for(uint32_t page = 0; page < tiles.page_count(); page++)
+    {
+        uint32_t begin = page << page_order, end = std::min(begin + tiles.page_size, tile_count);
+        bool inner = next == border.size() || border[next] != page;  if(!inner)next++;
+        if(!tiles.page(page) && inner && buffers_idle(page))continue;  // nothing comes in
+        publish(phase + 2, begin);
+        for(uint32_t k = begin; k < end; k++)
+        {
+            uint32_t i = layout->tile_index(start + k);
+            context.wait_neighbors(i, phase + 1);
+            const Tile *tile = tiles.find(k);
+            uint32_t children_count = tile ? tile->children_count : 0;
+            if(children_count)for(; prefix < index; prefix++)  // ids need preceding groups
+            {
+                context.wait_group(prefix, phase + 1);  id += sync[prefix].children_count[slot];
+            }
+            consolidate(i, id, context.groups);  id += children_count;
+            if((tile = tiles.find(k)))
+            {
+                food_count += tile->food_count;
+                creature_count += tile->creature_count;
+                attack_count += tile->attack_count;
+            }
+            publish(phase + 2, k + 1);
+        }
+    }
+    publish(phase + 2, tile_count);
+
+    for(uint32_t page = 0; page < tiles.page_count(); page++)
+    {
+        const Tile *tile_page = tiles.page(page);  if(!tile_page)continue;
+        uint32_t begin = page << page_order, end = std::min(begin + tiles.page_size, tile_count);
+        publish(phase + 3, begin);
+        for(uint32_t k = begin; k < end; k++)
+        {
+            if(tile_page[k - begin].active())  // inactive tiles don't look at neighbors
+            {
+                uint32_t i = layout->tile_index(start + k);
+                context.wait_neighbors(i, phase + 2);
+                process_detectors(config, context.groups, i, &context);
+            }
+            publish(phase + 3, k + 1);
+        }
+    }
+    publish(phase + 3, tile_count);
+
+    for(uint32_t i = 0; i < group_count; i++)
+    {
+        context.wait_group(i, phase + 1);  next_id += sync[i].children_count[slot];
+    }
+    step_count++;
+}
+
 
 void TileGroup::Tile::update(const Config &config, uint64_t id, const Creature *&sel,
     FoodData *food_buf, CreatureData *creature_buf, SectorData *attack_buf) const
@@ -1457,21 +1876,33 @@ void TileGroup::Tile::update(const Config &config, uint64_t id, const Creature *
     assert(attack_ptr == attack_buf + attack_count);
 }
 
+void TileGroup::count_objects()
+{
+    food_count = creature_count = attack_count = 0;
+    for(uint32_t page = 0; page < tiles.page_count(); page++)if(const Tile *tile = tiles.page(page))
+    {
+        for(uint32_t k = page << page_order; k < std::min((page + 1) << page_order, tile_count); k++, tile++)
+        {
+            food_count += tile->food_count;
+            creature_count += tile->creature_count;
+            attack_count += tile->attack_count;
+        }
+    }
+}
+
 const Creature *TileGroup::update(const Config &config, uint64_t id,
-    FoodData *food_buf, const std::vector<size_t> &food_offs,
-    CreatureData *creature_buf, const std::vector<size_t> &creature_offs,
-    SectorData *attack_buf, const std::vector<size_t> &attack_offs) const
+    FoodData *food_buf, CreatureData *creature_buf, SectorData *attack_buf) const
 {
     const Creature *sel = nullptr;
-    for(auto &tile : tiles)
+    for(uint32_t page = 0; page < tiles.page_count(); page++)if(const Tile *tile = tiles.page(page))
     {
-        uint32_t index = tile.x | (tile.y << config.order_x);
-        assert(food_offs[index + 1] - food_offs[index] == tile.food_count);
-        assert(creature_offs[index + 1] - creature_offs[index] == tile.creature_count);
-        assert(attack_offs[index + 1] - attack_offs[index] == tile.attack_count);
-
-        tile.update(config, id, sel, food_buf + food_offs[index],
-            creature_buf + creature_offs[index], attack_buf + attack_offs[index]);
+        for(uint32_t k = page << page_order; k < std::min((page + 1) << page_order, tile_count); k++, tile++)
+        {
+            tile->update(config, id, sel, food_buf, creature_buf, attack_buf);
+            food_buf += tile->food_count;
+            creature_buf += tile->creature_count;
+            attack_buf += tile->attack_count;
+        }
     }
     return sel;
 }
@@ -1496,22 +1927,27 @@ bool TileGroup::Tile::hit_test(const Position pos, uint64_t max_r2, const Creatu
 
 void TileGroup::thread_proc(Context *context, uint32_t index)
 {
-    uint32_t stage = context->groups.size();
-    TileGroup &group = context->groups[index];
+    uint32_t stage = context->group_count;
     for(Context::Command cmd = context->first_wait(stage);;)switch(cmd)
     {
     case Context::c_step:
-        group.execute_step(context->config);  context->barrier(stage);
-        group.consolidate(context->layout, context->groups);  context->barrier(stage);
-        group.process_detectors(context->config, context->layout, context->groups);
+        context->groups[index].step(*context, index, context->current_time);
+        cmd = context->end_step(stage);  continue;
+
+    case Context::c_step_n:
+        for(uint32_t i = 0; i < context->step_n; i++)context->groups[index].step(*context, index, context->current_time + i);
         cmd = context->end_step(stage);  continue;
 
+    case Context::c_task:
+        context->run_tasks();
+        cmd = context->end_task(stage);  continue;
+
     case Context::c_draw:
         {
-            const Creature *sel = group.update(context->config, context->sel_id,
-                context->food_buf, context->food_offs,
-                context->creature_buf, context->creature_offs,
-                context->attack_buf, context->attack_offs);
+            const Creature *sel = context->groups[index].update(context->config, context->sel_id,
+                context->food_buf + context->food_offs[index],
+                context->creature_buf + context->creature_offs[index],
+                context->attack_buf + context->attack_offs[index]);
             cmd = context->end_draw(stage, sel);  continue;
         }
 
@@ -1521,16 +1957,18 @@ void TileGroup::thread_proc(Context *context, uint32_t index)
 }
 
 
-bool TileGroup::Tile::load(const Config &config, InStream &stream, uint64_t next_id, uint64_t *buf)
+bool TileGroup::Tile::load(const Config &config, InStream &stream, uint32_t index, uint64_t next_id, uint64_t *buf, bool legacy)
 {
+    // into a free-standing tile, it's taken by the owning group afterwards
     assert(foods.empty() && !first);
-    uint64_t offs_x = uint64_t(x) << tile_order;
-    uint64_t offs_y = uint64_t(y) << tile_order;
-
     stream.assert_align(8);
-    stream >> rand >> spawn_start >> creature_count;
+    Random rand;  if(legacy)stream >> rand;  // stored random state is dropped, it's derived from time now
+    stream >> spawn_start >> creature_count;
     if(!stream)return false;  // TODO: check counts
 
+    uint64_t offs_x = uint64_t(index & config.mask_x) << tile_order;
+    uint64_t offs_y = uint64_t(index >> config.order_x) << tile_order;
+
     foods.resize(spawn_start);  food_count = 0;
     for(auto &food : foods)
     {
@@ -1541,7 +1979,7 @@ bool TileGroup::Tile::load(const Config &config, InStream &stream, uint64_t next
     attack_count = 0;
     for(uint32_t i = 0; i < creature_count; i++)
     {
-        Creature *cr = Creature::load(config, stream, next_id, buf);
+        Creature *cr = Creature::load(config, stream, next_id, buf, legacy);
         if(!cr)
         {
             *last = nullptr;  return false;
@@ -1553,10 +1991,15 @@ bool TileGroup::Tile::load(const Config &config, InStream &stream, uint64_t next
     *last = nullptr;  return true;
 }
 
-void TileGroup::Tile::save(OutStream &stream, uint64_t *buf) const
+bool TileGroup::Tile::stored() const
 {
-    stream.assert_align(8);  stream << rand;
+    if(first)return true;
+    for(auto &food : foods)if(food.type)return true;
+    return false;
+}
 
+void TileGroup::Tile::save(OutStream &stream, uint64_t *buf) const
+{
     uint32_t n = 0;
     for(auto &food : foods)if(food.type)n++;
     stream << n << creature_count;
@@ -1567,14 +2010,114 @@ void TileGroup::Tile::save(OutStream &stream, uint64_t *buf) const
 
 
 
+bool TileGroup::load_tile(const Config &config, InStream &stream, uint32_t index, uint64_t next_id, uint64_t *buf, bool legacy)
+{
+    Tile tile;
+    if(!tile.load(config, stream, index, next_id, buf, legacy))return false;
+    if(tile.spawn_start || tile.creature_count)tiles[local(index)].take(tile);  // empty tiles stay unallocated
+    return true;
+}
+
+void TileGroup::save_tile(OutStream &stream, uint32_t index, uint64_t *buf) const
+{
+    stream.assert_align(8);  get_tile(index).save(stream, buf);
+}
+
+
+
 // Context struct
 
+void Context::alloc_phases()
+{
+    group_sync.reset(new GroupSync[groups.size()]);
+    for(size_t i = 0; i < groups.size(); i++)
+    {
+        group_sync[i].progress.store(groups[i].tile_count, std::memory_order_relaxed);  // phase 0 done
+        group_sync[i].split.store(nullptr, std::memory_order_relaxed);
+        group_sync[i].split_users.store(0, std::memory_order_relaxed);
+    }
+    split_count.store(0, std::memory_order_relaxed);
+}
+
+void Context::wait_phase(const std::atomic<uint64_t> &progress, uint64_t target) const
+{
+    const int spin_count = 256;
+    for(int n = 0; int64_t(progress.load(std::memory_order_acquire) - target) < 0; n++)
+    {
+        if(help_split())continue;
+        if(n >= spin_count)std::this_thread::yield();
+    }
+}
+
+void Context::wait_neighbors(uint32_t index, uint32_t phase) const
+{
+    // own group finishes every pass before the next one
+    if(layout.inner(index))return;
+
+    uint32_t near[9];  layout.neighborhood(index, near);
+    for(int i = 0; i < 9; i++)if(i != 4)
+    {
+        Reference ref = layout.tile(near[i]);
+        wait_phase(group_sync[ref.group].progress, (uint64_t(phase) << 32) + ref.index + 1);
+    }
+}
+
+void Context::wait_group(uint32_t index, uint32_t phase) const
+{
+    wait_phase(group_sync[index].progress, uint64_t(phase) << 32 | groups[index].tile_count);
+}
+
+
+// Heavy tiles are split into chunks, the owner publishes them in its GroupSync and takes chunks itself,
+// other workers take them while waiting in wait_phase() (but not while sleeping between commands).
+// Chunk results don't depend on the executing thread, so the step stays deterministic.
+// The task lives on the owner's stack: it's unpublished and then every user is waited out.
+
+void Context::run_split(uint32_t index, size_t count, const std::function<void(size_t)> &proc) const
+{
+    SplitTask task;  task.proc = &proc;  task.count = count;
+    task.next.store(0, std::memory_order_relaxed);
+    task.done.store(0, std::memory_order_relaxed);
+
+    GroupSync &sync = group_sync[index];
+    sync.split.store(&task);  split_count.fetch_add(1, std::memory_order_relaxed);
+    for(size_t i; (i = task.next.fetch_add(1, std::memory_order_relaxed)) < count;)
+    {
+        proc(i);  task.done.fetch_add(1, std::memory_order_release);
+    }
+    while(task.done.load(std::memory_order_acquire) < count)std::this_thread::yield();
+
+    sync.split.store(nullptr);  split_count.fetch_sub(1, std::memory_order_relaxed);
+    while(sync.split_users.load())std::this_thread::yield();
+}
+
+bool Context::help_split() const
+{
+    if(!split_count.load(std::memory_order_relaxed))return false;
+
+    bool res = false;
+    for(uint32_t i = 0; i < group_count; i++)
+    {
+        GroupSync &sync = group_sync[i];
+        if(!sync.split.load(std::memory_order_relaxed))continue;
+
+        sync.split_users.fetch_add(1);
+        if(SplitTask *task = sync.split.load())
+            for(size_t k; (k = task->next.fetch_add(1, std::memory_order_relaxed)) < task->count;)
+            {
+                (*task->proc)(k);  task->done.fetch_add(1, std::memory_order_release);  res = true;
+            }
+        sync.split_users.fetch_sub(1, std::memory_order_release);
+    }
+    return res;
+}
+
 void Context::start()
 {
     stage = 0;  cmd = c_stop;
 }
 
-void Context::pre_execute()
+void Context::pre_execute() const
 {
     std::unique_lock<std::mutex> lock(mutex);
     while(cmd)
@@ -1584,7 +2127,7 @@ void Context::pre_execute()
     lock.release();
 }
 
-void Context::post_execute(Command new_cmd)
+void Context::post_execute(Command new_cmd) const
 {
     std::unique_lock<std::mutex> lock(mutex, std::adopt_lock);
     if((cmd = new_cmd))
@@ -1605,9 +2148,14 @@ void Context::execute(Command new_cmd)
 }
 
 
+void Context::run_tasks() const
+{
+    for(size_t i; (i = task_next.fetch_add(1, std::memory_order_relaxed)) < task_count;)(*task)(i);
+}
+
 Context::Command Context::first_wait(uint32_t &target)
 {
-    uint32_t n = groups.size();
+    uint32_t n = group_count;
     std::unique_lock<std::mutex> lock(mutex);
     if(++stage == target)
     {
@@ -1618,35 +2166,40 @@ Context::Command Context::first_wait(uint32_t &target)
     target += n;  return cmd;
 }
 
-void Context::barrier(uint32_t &target)
+Context::Command Context::end_step(uint32_t &target)
 {
-    uint32_t n = groups.size();
+    uint32_t n = group_count;
     std::unique_lock<std::mutex> lock(mutex);
-    if(++stage == target)cond_work.notify_all();
+    assert(cmd == c_step || cmd == c_step_n);
+    if(++stage == target)
+    {
+        current_time += cmd == c_step_n ? step_n : 1;  cmd = c_none;
+        cond_cmd.notify_one();
+    }
     else while(stage - target >= n)cond_work.wait(lock);
-    target += n;
+    while(!cmd)cond_work.wait(lock);
+    target += n;  return cmd;
 }
 
-Context::Command Context::end_step(uint32_t &target)
+Context::Command Context::end_draw(uint32_t &target, const Creature *cr)
 {
-    uint32_t n = groups.size();
+    uint32_t n = group_count;
     std::unique_lock<std::mutex> lock(mutex);
-    assert(cmd == c_step);
+    assert(cmd == c_draw);  if(cr)sel = cr;
     if(++stage == target)
     {
-        current_time++;  cmd = c_none;
-        cond_cmd.notify_one();
+        cmd = c_none;  cond_cmd.notify_one();
     }
     else while(stage - target >= n)cond_work.wait(lock);
     while(!cmd)cond_work.wait(lock);
     target += n;  return cmd;
 }
 
-Context::Command Context::end_draw(uint32_t &target, const Creature *cr)
+Context::Command Context::end_task(uint32_t &target)
 {
-    uint32_t n = groups.size();
+    uint32_t n = group_count;
     std::unique_lock<std::mutex> lock(mutex);
-    assert(cmd == c_draw);  if(cr)sel = cr;
+    assert(cmd == c_task);
     if(++stage == target)
     {
         cmd = c_none;  cond_cmd.notify_one();
@@ -1660,10 +2213,31 @@ Context::Command Context::end_draw(uint32_t &target, const Creature *cr)
 
 // World struct
 
-const char version_string[] = "Evol0004";
+// Evol0005: independent chunks, every one located and hashed by the footer:
+//   chunk 0: version, config, current time, next id, seed, count of tile chunks;
+//   tile chunk: its number (increasing), then its chunk_tiles tiles in layout index order,
+//     only chunks with anything stored are written;
+//   footer: offset, size and hash of every chunk, chunk count, root hash of the footer so far, version.
+// Evol0004, the earlier format, is a single OutFileStream: every 64 KiB frame is followed by a hash state,
+// every tile by its random state, and Genome::save() padded every chromosome count to 8 bytes
+// (Evol0005 packs the counts and pads once), so loaders down to Genome::load() take the legacy flag.
 
+const char version_string[] = "Evol0005";  // independent chunks with footer index and root hash
+const char legacy_version[] = "Evol0004";  // plain sequence of tiles, still readable
+const uint32_t chunk_tiles = 64;  // restart chunk
+const uint64_t legacy_seed = 1234;  // Evol0004 has random state of every tile instead
 
-World::World(uint32_t group_count) : group_count(group_count)
+struct ChunkEntry
+{
+    uint64_t offset, size;
+    char hash[Hash::result_size];
+};
+
+const size_t entry_size = 16 + Hash::result_size;  // offset, size, hash
+const size_t tail_size = 8 + Hash::result_size + 8;  // chunk count, root hash, version
+
+
+World::World(uint32_t group_count) : Context(group_count)
 {
 }
 
@@ -1673,9 +2247,9 @@ World::~World()
 }
 
 
-void World::init()
+void World::init(uint8_t order_x, uint8_t order_y, bool populate)
 {
-    config.order_x = config.order_y = 6;  // 64 x 64
+    config.order_x = order_x;  config.order_y = order_y;  // 64 x 64 by default
     config.base_radius = tile_size / 64;
 
     config.chromosome_bits = 4;  // 16 = 8 pair
@@ -1728,76 +2302,84 @@ void World::init()
     assert(res);  (void)res;
 
 
-    uint64_t seed = 1234;
+    seed = 1234;
     uint32_t exp_grass_gen    = uint32_t(-1) >> 8;
     uint32_t exp_creature_gen = uint32_t(-1) >> 4;
     int grass_gen_mul = 16;
 
 
+    // tiles are generated by their groups in parallel with ids relative to tile,
+    // every tile has its own random state, so the result doesn't depend on group count
+
     build_layout();
-    Genome init_genome(config);  uint64_t next_id = 0;
-    for(size_t i = 0; i < layout.size(); i++)
-    {
-        Tile &tile = groups[layout[i].group].tiles[layout[i].index];
-        tile.rand = Random(seed, i);
+    Genome init_genome(config);
+    if(populate)parallel_for(groups.size(), [&](size_t g)
+        {
+            TileGroup &group = groups[g];
+            for(uint32_t k = 0; k < group.tile_count; k++)
+            {
+                uint32_t i = layout.tile_index(group.start + k);
+                Random rand(seed, i);
 
-        uint64_t offs_x = uint64_t(tile.x) << tile_order;
-        uint64_t offs_y = uint64_t(tile.y) << tile_order;
+                uint64_t offs_x = uint64_t(i & config.mask_x) << tile_order;
+                uint64_t offs_y = uint64_t(i >> config.order_x) << tile_order;
 
-        uint32_t n = 0;
-        for(int k = 0; k < grass_gen_mul; k++)
-            n += tile.rand.poisson(exp_grass_gen);
-        for(uint32_t k = 0; k < n; k++)
-        {
-            uint64_t xx = (tile.rand.uint32() & tile_mask) | offs_x;
-            uint64_t yy = (tile.rand.uint32() & tile_mask) | offs_y;
-            tile.foods.emplace_back(config, Food::grass, Position{xx, yy});
-        }
-        tile.spawn_start = tile.food_count = n;
+                uint32_t n = 0;
+                for(int j = 0; j < grass_gen_mul; j++)
+                    n += rand.poisson(exp_grass_gen);
+                Tile *tile = n ? &group.tiles[k] : nullptr;  // empty tiles stay unallocated
+                for(uint32_t j = 0; j < n; j++)
+                {
+                    uint64_t xx = (rand.uint32() & tile_mask) | offs_x;
+                    uint64_t yy = (rand.uint32() & tile_mask) | offs_y;
+                    tile->foods.emplace_back(config, Food::grass, Position{xx, yy});
+                }
+                if(tile)tile->spawn_start = tile->food_count = n;
 
-        n = tile.rand.poisson(exp_creature_gen);
-        for(uint32_t k = 0; k < n; k++)
-        {
-            angle_t angle = tile.rand.uint32();
-            uint64_t xx = (tile.rand.uint32() & tile_mask) | offs_x;
-            uint64_t yy = (tile.rand.uint32() & tile_mask) | offs_y;
-            Genome genome(config, tile.rand, init_genome, nullptr);
-            Creature *cr = Creature::spawn(config, genome,
-                next_id++, Position{xx, yy}, angle, uint64_t(-1));
-            *tile.last = cr;  tile.last = &cr->next;
-        }
-        *tile.last = nullptr;  tile.creature_count = n;  tile.attack_count = 0;
-    }
-    for(auto &group : groups)
+                n = rand.poisson(exp_creature_gen);
+                if(!n)continue;
+                if(!tile)tile = &group.tiles[k];
+                for(uint32_t j = 0; j < n; j++)
+                {
+                    angle_t angle = rand.uint32();
+                    uint64_t xx = (rand.uint32() & tile_mask) | offs_x;
+                    uint64_t yy = (rand.uint32() & tile_mask) | offs_y;
+                    Genome genome(config, rand, init_genome, nullptr);
+                    Creature *cr = Creature::spawn(config, genome,
+                        j, Position{xx, yy}, angle, uint64_t(-1));
+                    *tile->last = cr;  tile->last = &cr->next;
+                }
+                *tile->last = nullptr;  tile->creature_count = n;  tile->attack_count = 0;
+            }
+        });
+
+    uint64_t next_id = 0;  // ids in index order
+    for(size_t i = 0; populate && i < layout.size(); i++)
     {
-        group.next_id = next_id;
-        group.process_detectors(config, layout, groups);
+        Reference ref = layout.tile(i);
+        Tile *tile = groups[ref.group].tiles.find(ref.index);  if(!tile)continue;
+        for(Creature *cr = tile->first; cr; cr = cr->next)cr->id += next_id;
+        next_id += tile->creature_count;
     }
+    for(auto &group : groups)group.next_id = next_id;
+    parallel_for(groups.size(), [this](size_t i)
+        {
+            groups[i].process_detectors(config, groups);
+            groups[i].count_objects();
+        });
     current_time = 0;
 }
 
 void World::build_layout()
 {
-    TileLayout scheme(config.mask_x + 1, config.mask_y + 1, group_count);
-    scheme.build_layout();
-
+    layout.init(config, group_count);
     groups.resize(group_count);
-    for(uint32_t i = 0; i < group_count; i++)groups[i].alloc(scheme.groups[i]);
-
-    layout.resize(scheme.tiles.size());
-    for(size_t i = 0; i < layout.size(); i++)
-    {
-        layout[i] = scheme.tiles[i];
-        Tile &tile = groups[layout[i].group].tiles[layout[i].index];
-        tile.init(scheme.tiles[i]);
+    for(uint32_t i = 0; i < group_count; i++)groups[i].alloc(layout, i);
 
-        tile.x = i & config.mask_x;
-        tile.y = i >> config.order_x;
-    }
-
-    food_offs.resize(layout.size() + 1);
-    creature_offs.resize(layout.size() + 1);
-    attack_offs.resize(layout.size() + 1);
+    food_offs.resize(group_count + 1);
+    creature_offs.resize(group_count + 1);
+    attack_offs.resize(group_count + 1);
+    alloc_phases();
 }
 
 
@@ -1817,6 +2399,14 @@ void World::next_step()
     post_execute(c_step);  pre_execute();
 }
 
+void World::run_steps(uint32_t n)
+{
+    // workers loop over n steps without returning to the main thread
+
+    if(!n)return;
+    step_n = n;  post_execute(c_step_n);  pre_execute();
+}
+
 void World::stop()
 {
     post_execute(c_stop);
@@ -1824,21 +2414,78 @@ void World::stop()
     threads.clear();
 }
 
+void World::relayout(uint32_t n, TileLayout::Ordering ordering)
+{
+    bool running = !threads.empty();
+    if(running)stop();
+
+    // pending eaters are credited as collect_food() would do, then active tiles are moved
+    std::vector<TileGroup> prev_groups;  prev_groups.swap(groups);
+    for(auto &group : prev_groups)
+        for(size_t page = 0; page < group.eaters.page_count(); page++)if(auto *eaters = group.eaters.page(page))
+            for(uint32_t k = 0; k < group.eaters.page_size; k++)
+            {
+                for(const Creature *cr : eaters[k])cr->food_energy += config.food_energy;
+                eaters[k].clear();
+            }
+
+    TileLayout prev_layout = layout;
+    group_count = n;  layout.ordering = ordering;  build_layout();
+    for(auto &group : prev_groups)
+        for(uint32_t page = 0; page < group.tiles.page_count(); page++)if(Tile *tile = group.tiles.page(page))
+        {
+            for(uint32_t k = page << page_order; k < std::min((page + 1) << page_order, group.tile_count); k++, tile++)
+            {
+                if(!tile->active())continue;
+                Reference ref = layout.tile(prev_layout.tile_index(group.start + k));
+                groups[ref.group].tiles[ref.index].take(*tile);
+            }
+        }
+    for(auto &group : groups)
+    {
+        group.next_id = prev_groups[0].next_id;  group.count_objects();
+    }
+
+    if(running)start();
+}
+
+void World::set_worker_count(uint32_t n)
+{
+    assert(n);  if(n != group_count)relayout(n, layout.ordering);
+}
+
+void World::set_ordering(TileLayout::Ordering ordering)
+{
+    if(ordering != layout.ordering)relayout(group_count, ordering);
+}
+
+
+void World::parallel_for(size_t count, const std::function<void(size_t)> &proc) const
+{
+    // tasks are taken in arbitrary order, results should be stored per index
+
+    if(threads.empty())
+    {
+        for(size_t i = 0; i < count; i++)proc(i);
+        return;
+    }
+    task = &proc;  task_count = count;  task_next.store(0, std::memory_order_relaxed);
+    post_execute(c_task);  run_tasks();  pre_execute();
+}
+
 
 void World::count_objects()
 {
+    // group totals are maintained by the workers, draw buffers are filled group by group
+
     food_offs[0] = creature_offs[0] = attack_offs[0] = 0;
-    size_t food_count = 0, creature_count = 0, attack_count = 0;
-    for(size_t i = 0; i < layout.size(); i++)
+    for(size_t i = 0; i < groups.size(); i++)
     {
-        Tile &tile = groups[layout[i].group].tiles[layout[i].index];
-
-        food_offs[i + 1] = food_count += tile.food_count;
-        creature_offs[i + 1] = creature_count += tile.creature_count;
-        attack_offs[i + 1] = attack_count += tile.attack_count;
+        food_offs[i + 1] = food_offs[i] + groups[i].food_count;
+        creature_offs[i + 1] = creature_offs[i] + groups[i].creature_count;
+        attack_offs[i + 1] = attack_offs[i] + groups[i].attack_count;
     }
 }
-
 const Creature *World::update(FoodData *food_buf, CreatureData *creature_buf, SectorData *attack_buf, uint64_t sel_id)
 {
     // count_objects() should be called prior
@@ -1870,36 +2517,277 @@ const Creature *World::hit_test(const Position &pos, uint32_t rad, uint64_t prev
 }
 
 
+void World::finish_load(uint64_t next_id)
+{
+    for(auto &group : groups)group.next_id = next_id;
+    parallel_for(groups.size(), [this](size_t i)
+        {
+            groups[i].process_detectors(config, groups);
+            groups[i].count_objects();
+        });
+}
+
+bool World::load_chunks(FileQueue &queue, const ChunkEntry *entries, size_t chunk_count, uint64_t next_id)
+{
+    // chunks of the next batch are read while the current one is checked and parsed in parallel into free-standing tiles,
+    // tile pages have a single writer, so they are moved into the groups afterwards
+
+    size_t total = (layout.size() + chunk_tiles - 1) / chunk_tiles;
+    size_t batch = std::min<size_t>(chunk_count, 4 * group_count);
+    std::vector<std::vector<char>> data[2];  data[0].resize(batch);  data[1].resize(batch);
+    auto fetch = [&](size_t start, std::vector<char> *buf)
+    {
+        bool res = true;
+        for(size_t k = 0; k < std::min(batch, chunk_count - start); k++)
+        {
+            buf[k].resize(entries[start + k].size);
+            res = res && queue.read(entries[start + k].offset, buf[k].data(), buf[k].size());
+        }
+        return queue.wait() && res;
+    };
+
+    std::vector<std::unique_ptr<Tile[]>> staged(batch);
+    for(auto &tiles : staged)tiles.reset(new Tile[chunk_tiles]);
+    std::unique_ptr<bool[]> valid(new bool[batch]);
+    std::vector<uint64_t> number(batch);  uint64_t next = 0;  // chunk numbers are increasing
+    bool ready = !chunk_count || fetch(0, data[0].data());
+    for(size_t start = 0, cur = 0; start < chunk_count; start += batch, cur ^= 1)
+    {
+        if(!ready)return false;
+        size_t n = std::min(batch, chunk_count - start), readers = start + batch < chunk_count ? 1 : 0;
+        parallel_for(readers + n, [&](size_t k)
+            {
+                if(k < readers)
+                {
+                    ready = fetch(start + batch, data[cur ^ 1].data());  return;
+                }
+                k -= readers;
+
+                const std::vector<char> &chunk = data[cur][k];
+                Hash hash;  hash.process(chunk.data(), chunk.size());
+                valid[k] = !std::memcmp(hash.result(), entries[start + k].hash, Hash::result_size);  if(!valid[k])return;
+                InBufferStream in(chunk.data(), chunk.size());
+                valid[k] = in.initialize() && (in >> number[k]) && number[k] < total;
+                std::vector<uint64_t> buf(std::max<uint32_t>(1, config.slot_bits >> 6));
+                size_t i = number[k] * chunk_tiles, end = std::min<size_t>(i + chunk_tiles, layout.size());
+                for(uint32_t j = 0; valid[k] && i < end; i++, j++)
+                    valid[k] = staged[k][j].load(config, in, i, next_id, buf.data(), false);
+                valid[k] = valid[k] && in.at_end();
+            });
+
+        for(size_t k = 0; k < n; k++)
+        {
+            if(!valid[k] || number[k] < next)return false;
+            next = number[k] + 1;
+        }
+        for(size_t k = 0; k < n; k++)
+        {
+            size_t i = number[k] * chunk_tiles, end = std::min<size_t>(i + chunk_tiles, layout.size());
+            for(uint32_t j = 0; i < end; i++, j++)
+            {
+                Tile &tile = staged[k][j];  if(!tile.spawn_start && !tile.creature_count)continue;
+                Reference ref = layout.tile(i);  groups[ref.group].tiles[ref.index].take(tile);
+            }
+        }
+    }
+    return true;
+}
+
 bool World::load(InStream &stream)
 {
-    stream.assert_align(8);  char header[8];  stream.get(header, 8);
-    if(!stream || std::memcmp(header, version_string, sizeof(header)))return false;
-    uint64_t next_id;  stream >> config >> align(8) >> current_time >> next_id;
+    stream.assert_align(8);  char header[8];  stream.get(header, 8);  if(!stream)return false;
+    bool legacy = !std::memcmp(header, legacy_version, sizeof(header));
+    if(!legacy && std::memcmp(header, version_string, sizeof(header)))return false;
+    uint64_t next_id, chunk_count = 0;  stream >> config >> align(8) >> current_time >> next_id;
+    seed = legacy_seed;  if(!legacy)stream >> seed >> chunk_count;
     if(!stream)return false;
 
+    // chunks of a sequential stream are parsed in place, the stream has its own hash
     build_layout();
     std::vector<uint64_t> buf(std::max<uint32_t>(1, config.slot_bits >> 6));
-    for(size_t i = 0; i < layout.size(); i++)
+    size_t total = (layout.size() + chunk_tiles - 1) / chunk_tiles;
+    if(legacy)
     {
-        Tile &tile = groups[layout[i].group].tiles[layout[i].index];
-        if(!tile.load(config, stream, next_id, buf.data()))return false;
+        for(size_t i = 0; i < layout.size(); i++)
+            if(!groups[layout.group(i)].load_tile(config, stream, i, next_id, buf.data(), true))return false;
     }
-    for(auto &group : groups)
+    else for(uint64_t k = 0, next = 0; k < chunk_count; k++)
     {
-        group.next_id = next_id;
-        group.process_detectors(config, layout, groups);
+        uint64_t number;  stream >> number;
+        if(!stream || number < next || number >= total)return false;
+        size_t i = number * chunk_tiles, end = std::min<size_t>(i + chunk_tiles, layout.size());
+        for(; i < end; i++)
+            if(!groups[layout.group(i)].load_tile(config, stream, i, next_id, buf.data(), false))return false;
+        next = number + 1;
     }
-    return true;
+
+    if(!legacy)
+    {
+        size_t count = 1 + chunk_count;
+        std::vector<char> index(count * entry_size + 8);  char tail[Hash::result_size + 8];
+        if(!stream.get(index.data(), index.size()) || !stream.get(tail, sizeof(tail)))return false;
+
+        uint64_t n;  std::memcpy(&n, index.data() + count * entry_size, 8);
+        Hash hash;  hash.process(index.data(), index.size());
+        if(to_le64(n) != count || std::memcmp(hash.result(), tail, Hash::result_size))return false;
+        if(std::memcmp(tail + Hash::result_size, version_string, 8))return false;
+    }
+    finish_load(next_id);  return true;
 }
 
-void World::save(OutStream &stream) const
+bool World::chunked(const ChunkFile &file)
 {
-    stream.assert_align(8);  stream.put(version_string, 8);
-    stream << config << align(8) << current_time << groups[0].next_id;
-    std::vector<uint64_t> buf(std::max<uint32_t>(1, config.slot_bits >> 6));
-    for(size_t i = 0; i < layout.size(); i++)
+    char header[8];
+    return file.read(0, header, sizeof(header)) && !std::memcmp(header, version_string, sizeof(header));
+}
+
+bool World::load(const ChunkFile &file, unsigned depth)
+{
+    // footer is checked against the root hash, then every chunk against its own hash
+
+    uint64_t file_size;  char tail[tail_size];
+    if(!file.size(file_size) || file_size < tail_size)return false;
+    if(!file.read(file_size - tail_size, tail, tail_size))return false;
+    if(std::memcmp(tail + tail_size - 8, version_string, 8))return false;
+
+    uint64_t count;  std::memcpy(&count, tail, 8);  count = to_le64(count);
+    if(!count || count > (file_size - tail_size) / entry_size)return false;
+    uint64_t index_offs = file_size - tail_size - count * entry_size;
+    std::vector<char> index(count * entry_size + 8);
+    if(!file.read(index_offs, index.data(), index.size()))return false;
+    Hash hash;  hash.process(index.data(), index.size());
+    if(std::memcmp(hash.result(), tail + 8, Hash::result_size))return false;
+
+    std::vector<ChunkEntry> entries(count);
+    InBufferStream in(index.data(), count * entry_size);  if(!in.initialize())return false;
+    for(auto &entry : entries)
     {
-        const Tile &tile = groups[layout[i].group].tiles[layout[i].index];
-        tile.save(stream, buf.data());
+        in >> entry.offset >> entry.size;  in.get(entry.hash, Hash::result_size);
+        if(!in || entry.size > index_offs || entry.offset > index_offs - entry.size)return false;
     }
+
+    std::vector<char> head(entries[0].size);
+    if(!file.read(entries[0].offset, head.data(), head.size()))return false;
+    Hash head_hash;  head_hash.process(head.data(), head.size());
+    if(std::memcmp(head_hash.result(), entries[0].hash, Hash::result_size))return false;
+    InBufferStream stream(head.data(), head.size());  char header[8];
+    if(!stream.initialize() || !stream.get(header, 8))return false;
+    if(std::memcmp(header, version_string, sizeof(header)))return false;
+    uint64_t next_id, chunk_count;  stream >> config >> align(8) >> current_time >> next_id >> seed >> chunk_count;
+    if(!stream || !stream.at_end() || count != 1 + chunk_count)return false;
+
+    build_layout();
+    FileQueue queue(file, depth);  if(!load_chunks(queue, entries.data() + 1, chunk_count, next_id))return false;
+    finish_load(next_id);  return true;
+}
+
+bool World::save_chunks(const std::function<bool(uint64_t, const std::vector<char> *, size_t)> &write, void *root) const
+{
+    // chunk 0 is the header, tile chunks with anything stored follow in layout index order,
+    // write gets consecutive chunks, a batch is written after its offsets are known, together with serialization of the next one
+
+    std::vector<std::vector<uint64_t>> found(groups.size());  // chunk numbers, from allocated pages only
+    parallel_for(groups.size(), [&](size_t g)
+        {
+            const TileGroup &group = groups[g];
+            for(uint32_t page = 0; page < group.tiles.page_count(); page++)if(const Tile *tile = group.tiles.page(page))
+            {
+                for(uint32_t k = page << page_order; k < std::min((page + 1) << page_order, group.tile_count); k++, tile++)
+                    if(tile->stored())found[g].push_back(layout.tile_index(group.start + k) / chunk_tiles);
+            }
+        });
+    std::vector<uint64_t> chunks;
+    for(const auto &list : found)chunks.insert(chunks.end(), list.begin(), list.end());
+    std::sort(chunks.begin(), chunks.end());
+    chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+
+    size_t chunk_count = chunks.size();
+    std::vector<ChunkEntry> entries(chunk_count + 1);
+    auto add_chunk = [&entries](size_t k, const std::vector<char> &data)
+    {
+        Hash hash;  hash.process(data.data(), data.size());
+        std::memcpy(entries[k].hash, hash.result(), Hash::result_size);  entries[k].size = data.size();
+    };
+
+    OutBufferStream head;  head.initialize();  head.put(version_string, 8);
+    head << config << align(8) << current_time << groups[0].next_id << seed << uint64_t(chunk_count);  head.finalize();
+    add_chunk(0, head.result);  entries[0].offset = 0;
+    if(write && !write(0, &head.result, 1))return false;
+
+    // tiles are serialized and hashed in parallel in bounded batches,
+    // the previous batch is written meanwhile by a single task
+    uint64_t offset = head.result.size();
+    size_t batch = std::min<size_t>(chunk_count, 4 * group_count), prev = 0, prev_n = 0;
+    std::vector<std::vector<char>> data[2];  data[0].resize(batch);  data[1].resize(batch);
+    bool written = true;
+    for(size_t start = 0, cur = 0;; start += batch, cur ^= 1)
+    {
+        size_t n = start < chunk_count ? std::min(batch, chunk_count - start) : 0;
+        size_t writers = write && prev_n ? 1 : 0;
+        if(n + writers)parallel_for(writers + n, [&](size_t k)
+            {
+                if(k < writers)
+                {
+                    written = write(entries[prev + 1].offset, data[cur ^ 1].data(), prev_n);  return;
+                }
+                k -= writers;
+
+                OutBufferStream out;  out.initialize();  out << chunks[start + k];
+                std::vector<uint64_t> buf(std::max<uint32_t>(1, config.slot_bits >> 6));
+                size_t i = chunks[start + k] * chunk_tiles, end = std::min<size_t>(i + chunk_tiles, layout.size());
+                for(; i < end; i++)groups[layout.group(i)].save_tile(out, i, buf.data());
+                out.finalize();  data[cur][k].swap(out.result);  add_chunk(start + k + 1, data[cur][k]);
+            });
+        if(!written)return false;
+        if(!n)break;
+
+        for(size_t k = 0; k < n; k++)
+        {
+            entries[start + k + 1].offset = offset;  offset += data[cur][k].size();
+        }
+        prev = start;  prev_n = n;
+    }
+
+    // footer: offset, size and hash of every chunk, count, root hash of all that and version
+    OutBufferStream footer;  footer.initialize();
+    for(const auto &entry : entries)
+    {
+        footer << entry.offset << entry.size;  footer.put(entry.hash, Hash::result_size);
+    }
+    footer << uint64_t(entries.size());  footer.finalize();
+    Hash hash;  hash.process(footer.result.data(), footer.result.size());
+    std::memcpy(root, hash.result(), Hash::result_size);
+
+    const char *res = static_cast<const char *>(hash.result());
+    footer.result.insert(footer.result.end(), res, res + Hash::result_size);
+    footer.result.insert(footer.result.end(), version_string, version_string + 8);
+    return !write || write(offset, &footer.result, 1);
+}
+
+void World::save(OutStream &stream) const
+{
+    char root[Hash::result_size];  stream.assert_align(8);
+    save_chunks([&stream](uint64_t, const std::vector<char> *data, size_t n) -> bool
+        {
+            for(size_t k = 0; k < n; k++)stream.put(data[k].data(), data[k].size());
+            return true;
+        }, root);
+}
+
+bool World::save(const ChunkFile &file, void *root, unsigned depth) const
+{
+    // chunks of a batch are in flight together, all of them are done before the buffers are reused
+    FileQueue queue(file, depth);
+    return save_chunks([&queue](uint64_t offset, const std::vector<char> *data, size_t n)
+        {
+            bool res = true;
+            for(size_t k = 0; k < n; offset += data[k++].size())
+                res = res && queue.write(offset, data[k].data(), data[k].size());
+            return queue.wait() && res;
+        }, root);
+}
+
+void World::checksum(void *root) const
+{
+    save_chunks(nullptr, root);
 }
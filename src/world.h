@@ -5,11 +5,15 @@
 
 
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
 #include <thread>
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include "evo_math.h"
+#include "network.h"
 
 
 namespace Slot
@@ -33,6 +37,13 @@ namespace Slot
 
 constexpr uint8_t slot_type_bits = 4;
 constexpr uint8_t flag_bits = 6;
+constexpr size_t cache_line = 64;
+constexpr uint32_t page_order = 6;  // tiles are allocated and skipped by pages, groups consist of whole pages
+#ifdef WORLD_NO_PADDING  // world_bench_nopad: hot fields share cache lines again, for comparison
+constexpr size_t cache_pad = 1;
+#else
+constexpr size_t cache_pad = cache_line;
+#endif
 
 typedef uint8_t slot_t;
 
@@ -81,6 +92,34 @@ struct Config
 };
 
 
+// gene field widths for decoding: taken from Config at run time
+// or fixed at compile time for common configurations
+
+struct GeneBits
+{
+    uint8_t chromosome_bits, slot_bits, base_bits;
+
+    explicit GeneBits(const Config &config) :
+        chromosome_bits(config.chromosome_bits), slot_bits(config.slot_bits), base_bits(config.base_bits)
+    {
+    }
+};
+
+template<uint8_t chromosome, uint8_t slot, uint8_t base> struct FixedGeneBits
+{
+    static constexpr uint8_t chromosome_bits = chromosome;
+    static constexpr uint8_t slot_bits = slot;
+    static constexpr uint8_t base_bits = base;
+
+    static bool match(const Config &config)
+    {
+        return config.chromosome_bits == chromosome && config.slot_bits == slot && config.base_bits == base;
+    }
+};
+
+typedef FixedGeneBits<4, 6, 8> DefaultGeneBits;  // World::init()
+
+
 struct Creature;
 
 struct Detector
@@ -161,7 +200,10 @@ struct Genome
     explicit Genome(const Config &config);
     Genome(const Config &config, Random &rand, const Genome &parent, const Genome *father);
 
-    bool load(const Config &config, InStream &stream);
+    template<typename Bits> void inherit(const Bits &bits, const Config &config,
+        Random &rand, const Genome &parent, const Genome *father);
+
+    bool load(const Config &config, InStream &stream, bool legacy);  // legacy: counts padded to 8 bytes (Evol0004)
     void save(OutStream &stream) const;
 };
 
@@ -231,11 +273,11 @@ private:
         }
 
         void create_slot(SlotData &slot, size_t link_pos);
-        void process_gene(const Config &config, Genome::Gene &gene, std::vector<LinkData> &links);
+        template<typename Bits> void process_gene(const Bits &bits, Genome::Gene &gene, std::vector<LinkData> &links);
     };
 
 
-    void update(const Config &config, const Genome &genome);
+    template<typename Bits> void update(const Bits &bits, const Genome &genome);
     void finalize();
 
 
@@ -346,23 +388,6 @@ struct Creature
     };
 
 
-    struct Neiron
-    {
-        int32_t act_level;
-        int32_t level;
-    };
-
-    struct Link
-    {
-        slot_t input, output;
-        int8_t weight;
-
-        Link(slot_t input, slot_t output, int8_t weight) : input(input), output(output), weight(weight)
-        {
-        }
-    };
-
-
     uint64_t id;
     Genome genome;
 
@@ -370,7 +395,7 @@ struct Creature
     angle_t angle;
     uint64_t energy, max_energy;
     Config::SlotCost passive_cost;
-    mutable std::atomic<uint64_t> food_energy;
+    mutable uint64_t food_energy;  // from TileGroup::collect_food()
     uint32_t total_life, max_life, damage, attack_count;
     uint64_t creature_vis_r2[f_creature];
     uint64_t food_vis_r2[2], claw_r2;
@@ -390,8 +415,8 @@ struct Creature
 
     std::vector<slot_t> order;
     std::vector<uint8_t> input;
-    std::vector<Neiron> neirons;
-    std::vector<Link> links;
+    Network net;
+    Network::State net_state;
 
     Creature *next;
 
@@ -414,13 +439,13 @@ struct Creature
     void update_view(uint8_t tg_flags, uint64_t r2, angle_t dir);
     void update_damage(const Creature *cr, uint64_t r2, angle_t dir);
     void process_food(const std::vector<Food> &foods);
-    void eat_food(std::vector<Food> &foods) const;
+    void eat_food(Food *food, size_t n) const;
     void process_detectors(const Creature *cr);
     void post_process(const Config &config);
 
     uint64_t execute_step(const Config &config);
 
-    static Creature *load(const Config &config, InStream &stream, uint64_t next_id, uint64_t *buf);
+    static Creature *load(const Config &config, InStream &stream, uint64_t next_id, uint64_t *buf, bool legacy);
     bool load(InStream &stream, uint64_t load_energy, uint64_t *buf);
     void save(OutStream &stream, uint64_t *buf) const;
 };
@@ -428,51 +453,119 @@ struct Creature
 
 struct TileLayout
 {
+    // Groups are contiguous ranges of tiles along the ordering curve, made of whole pages.
+    // Every group owns a buffer for every tile its own tiles can send objects to.
+    // In row-major order it's cyclic range of indices extended by 2 rows minus 1 in both directions,
+    // in Morton order own tiles come first, then neighbors from other groups (sorted list).
+
+    enum Ordering
+    {
+        l_rows, l_morton
+    };
+
     struct Reference
     {
         uint32_t group, index;
     };
 
-    struct TileDesc : public Reference
+    Ordering ordering;
+    uint32_t order_x, order_y, order, group_count;
+    uint32_t mask_x, mask_y, mask, halo, unit;  // unit: order of page, smaller for tiny worlds
+    std::vector<uint32_t> start;  // first position of every group
+    std::vector<std::vector<uint32_t>> border;  // pages of every group with neighbors in other groups
+    std::vector<std::vector<uint32_t>> outer;  // Morton order only
+
+
+    TileLayout() : ordering(l_rows)
     {
-        uint32_t neighbors[9];
-        Reference refs[9];
-        int ref_count;
-    };
+    }
 
-    struct GroupDesc
+    void init(const Config &config, uint32_t group_count);
+
+    size_t size() const
     {
-        uint32_t tile_count, ref_count;
+        return size_t(mask) + 1;
+    }
 
-        GroupDesc() : tile_count(0), ref_count(0)
-        {
-        }
-    };
+    uint32_t position(uint32_t index) const;  // place on the curve
+    uint32_t tile_index(uint32_t pos) const;
 
-    struct Offsets
+    uint32_t group_at(uint32_t pos) const
     {
-        uint32_t pos[3];
-        int8_t offs[3];
+        return (uint64_t(pos >> unit) * group_count) >> (order - unit);
+    }
 
-        Offsets(uint32_t p1, int8_t n1, uint32_t p2, int8_t n2, uint32_t p3, int8_t n3) :
-            pos{p1, p2, p3}, offs{n1, n2, n3}
-        {
-        }
+    uint32_t group(uint32_t index) const
+    {
+        return group_at(position(index));
+    }
 
-        Offsets(uint32_t center, uint32_t step, int8_t n) :
-            pos{center - step, center, center + step}, offs{n, 0, int8_t(-n)}
-        {
-        }
-    };
+    Reference tile(uint32_t index) const
+    {
+        uint32_t pos = position(index), res = group_at(pos);
+        return {res, pos - start[res]};
+    }
 
-    uint32_t size_x, size_y;
-    std::vector<TileDesc> tiles;
-    std::vector<GroupDesc> groups;
+    uint32_t buffer_count(uint32_t group) const;
+    uint32_t buffer_index(uint32_t group, uint32_t index) const;
 
-    TileLayout(uint32_t size_x, uint32_t size_y, uint32_t group_count);
-    void process_tile(TileDesc &cur, const Offsets &offs_x, const Offsets &offs_y);
-    void process_line(uint32_t pos, const Offsets &offs_y);
-    void build_layout();
+    void neighborhood(uint32_t index, uint32_t *res) const;  // 3x3 row-major
+    bool inner(uint32_t index) const;  // whole neighborhood in the same group
+    bool inner_page(uint32_t pos) const;  // same for every tile of the page starting at pos
+    int buffer_refs(uint32_t index, Reference *res) const;  // distinct groups of neighborhood
+};
+
+
+template<typename T> struct PagedArray
+{
+    // pages are allocated on the first write by the owning thread,
+    // reads from other threads see either nullptr or fully constructed page
+
+    static constexpr uint32_t page_size = 1 << page_order;
+
+    std::unique_ptr<std::atomic<T *>[]> pages;
+    std::vector<std::unique_ptr<T[]>> storage;
+    size_t size;
+
+
+    PagedArray() : size(0)
+    {
+    }
+
+    void reset(size_t n)
+    {
+        size_t page_count = (n + page_size - 1) >> page_order;
+        pages.reset(new std::atomic<T *>[page_count]);  storage.clear();  size = n;
+        for(size_t i = 0; i < page_count; i++)pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    size_t page_count() const
+    {
+        return (size + page_size - 1) >> page_order;
+    }
+
+    T *page(size_t index) const  // nullptr if not allocated
+    {
+        return pages[index].load(std::memory_order_acquire);
+    }
+
+    T *find(size_t index) const  // nullptr if not allocated
+    {
+        T *page = pages[index >> page_order].load(std::memory_order_acquire);
+        return page ? page + (index & (page_size - 1)) : nullptr;
+    }
+
+    T &operator [] (size_t index)  // owning thread only
+    {
+        std::atomic<T *> &page = pages[index >> page_order];
+        T *ptr = page.load(std::memory_order_relaxed);
+        if(!ptr)
+        {
+            storage.emplace_back(ptr = new T[page_size]);
+            page.store(ptr, std::memory_order_release);
+        }
+        return ptr[index & (page_size - 1)];
+    }
 };
 
 
@@ -480,6 +573,9 @@ struct FoodData;
 struct CreatureData;
 struct SectorData;
 struct Context;
+class ChunkFile;
+class FileQueue;
+struct ChunkEntry;
 
 struct TileGroup
 {
@@ -491,61 +587,136 @@ struct TileGroup
         Creature *first, **last;
         uint32_t food_count, creature_count, attack_count;
 
+        TileBuffer() : first(nullptr), last(&first), food_count(0), creature_count(0), attack_count(0)
+        {
+        }
+
         void append(Creature *cr)
         {
             *last = cr;  last = &cr->next;  creature_count++;
             attack_count += cr->attack_count;
         }
+
+        void clear()
+        {
+            foods.clear();  last = &first;
+            food_count = creature_count = attack_count = 0;
+        }
     };
 
     struct Tile : public TileBuffer
     {
-        uint32_t x, y;
-        uint32_t neighbors[9];
-        Reference refs[9];
-        int ref_count;
-
-        Random rand;
+        // only state used every step, topology is in TileLayout, random state is derived from time
         uint32_t spawn_start;
         uint32_t children_count;
-        uint64_t id_offset;  // TODO: memory layout
+        Creature *children;  // from execute_step() until consolidate()
+        Creature *del_queue;
 
         Tile();
         ~Tile();
-        void init(const TileLayout::TileDesc &desc);
+        void take(Tile &tile);
 
-        void process_detectors(const Config &config,
-            const std::vector<TileGroup> &groups, const Reference &ref);
+        static void process_creature(Creature *cr, const Tile &tile);
+        void process_foods(const Config &config, const Tile &tile, size_t begin, size_t end);
+        void process_detectors(const Config &config, const Tile &tile);
         void update(const Config &config, uint64_t id, const Creature *&sel,
             FoodData *food_buf, CreatureData *creature_buf, SectorData *attack_buf) const;
         bool hit_test(const Position pos, uint64_t max_r2, const Creature *&sel, uint64_t prev_id) const;
 
-        bool load(const Config &config, InStream &stream, uint64_t next_id, uint64_t *buf);
+        bool active() const
+        {
+            return first || !foods.empty();
+        }
+
+        bool load(const Config &config, InStream &stream, uint32_t index, uint64_t next_id, uint64_t *buf, bool legacy);
+        bool stored() const;  // save() writes something
         void save(OutStream &stream, uint64_t *buf) const;
     };
 
+    struct StepResult  // of split execute_step()
+    {
+        Position pos;
+        angle_t angle;
+        uint64_t dead_energy;
+    };
+
+    static const Tile empty_tile;  // shared by unallocated tiles
+
+    // tiles with more work are split into chunks shared with waiting workers
+    static constexpr uint32_t split_min_creatures = 256;  // execute_step()
+    static constexpr uint64_t split_min_pairs = uint64_t(1) << 16;  // process_detectors(): creatures x neighborhood objects
+    static constexpr uint32_t split_chunk = 64;
+
+
+    // tiles are allocated when objects first come in, pages without tiles are skipped by steps
+    static constexpr uint32_t sprout_block_order = 16;  // positions per random state of sprout events
 
+    const TileLayout *layout;
+    uint32_t id, start, tile_count;
+    PagedArray<Tile> tiles;
+    PagedArray<TileBuffer> buffers;
+    PagedArray<std::vector<const Creature *>> eaters;  // same indices as buffers
+
+    // written every step by owning thread only
+    char pad_front[cache_pad];
     uint64_t next_id;
-    std::vector<Tile> tiles;
-    std::vector<TileBuffer> buffers;
-    Creature *del_queue;
+    uint32_t step_count;
+    size_t food_count, creature_count, attack_count;
+    std::vector<uint32_t> sprouts;  // local positions with random sprouts this step
+    std::vector<std::pair<uint64_t, Creature *>> net_queue;
+    std::vector<uint8_t *> net_batch;
+    std::vector<Creature *> split_list;
+    std::vector<StepResult> split_results;
+    char pad_back[cache_pad];
+
+
+    void alloc(const TileLayout &layout, uint32_t index);
+
+    uint32_t local(uint32_t index) const
+    {
+        return layout->position(index) - start;
+    }
+
+    const Tile &get_tile(uint32_t index) const
+    {
+        const Tile *tile = tiles.find(local(index));
+        return tile ? *tile : empty_tile;
+    }
+
+    uint32_t buffer_index(uint32_t index) const
+    {
+        return layout->buffer_index(id, index);
+    }
 
+    TileBuffer &food_buffer(uint32_t buf, uint32_t index, Tile *tile)
+    {
+        // foods that stay in an active tile are added in place
+        return tile && buf == buffer_index(index) ? *tile : buffers[buf];
+    }
 
-    void alloc(const TileLayout::GroupDesc &desc);
+    bool buffers_idle(uint32_t page) const;  // no buffers for own tiles of page
 
-    uint32_t neighbor_index(const Config &config, const Tile &tile, Position &pos);
-    void spawn_grass(const Config &config, Tile &tile);
-    void spawn_meat(const Config &config, Tile &tile, Position pos, uint64_t energy);
+    uint32_t neighbor_index(const Config &config, Position &pos) const;
+    void find_sprouts(const Context &context, uint64_t time);
+    void spawn_grass(const Config &config, uint32_t index, Tile *tile, Random &rand, uint32_t sprouts);
+    void spawn_meat(const Config &config, uint32_t index, Tile *tile, Random &rand, Position pos, uint64_t energy);
 
-    void execute_step(const Config &config);
-    void consolidate(const std::vector<Reference> &layout, std::vector<TileGroup> &groups);
-    void process_detectors(const Config &config,
-        const std::vector<Reference> &layout, const std::vector<TileGroup> &groups);
+    static void execute_batches(std::vector<std::pair<uint64_t, Creature *>> &queue, std::vector<uint8_t *> &batch);
+    void execute_networks(const Tile &tile);
+    void collect_food(const Config &config, uint32_t index, std::vector<TileGroup> &groups) const;
+    void split_step(const Context &context, const Tile &tile);
+    void execute_step(Context &context, uint32_t index, uint64_t time, bool sprout);
+    void consolidate(uint32_t index, uint64_t id_offset, std::vector<TileGroup> &groups);
+    void process_detectors(const Config &config, const std::vector<TileGroup> &groups, uint32_t index, const Context *context);
+    void process_detectors(const Config &config, const std::vector<TileGroup> &groups);
+    void step(Context &context, uint32_t index, uint64_t time);
 
+    void count_objects();
     const Creature *update(const Config &config, uint64_t id,
-        FoodData *food_buf, const std::vector<size_t> &food_offs,
-        CreatureData *creature_buf, const std::vector<size_t> &creature_offs,
-        SectorData *attack_buf, const std::vector<size_t> &attack_offs) const;
+        FoodData *food_buf, CreatureData *creature_buf, SectorData *attack_buf) const;
+
+    bool load_tile(const Config &config, InStream &stream, uint32_t index, uint64_t next_id, uint64_t *buf, bool legacy);
+    void save_tile(OutStream &stream, uint32_t index, uint64_t *buf) const;
 
     static void thread_proc(Context *context, uint32_t index);
 };
@@ -557,33 +728,71 @@ struct Context
 
     enum Command
     {
-        c_none, c_step, c_draw, c_stop
+        c_none, c_step, c_step_n, c_draw, c_task, c_stop
     };
 
     Config config;
-    std::vector<Reference> layout;
+    TileLayout layout;
     std::vector<TileGroup> groups;
 
     FoodData *food_buf;
     CreatureData *creature_buf;
     SectorData *attack_buf;
-    std::vector<size_t> food_offs, creature_offs, attack_offs;
-    uint64_t current_time, sel_id;
+    std::vector<size_t> food_offs, creature_offs, attack_offs;  // per group
+    uint64_t current_time, seed, sel_id;  // random state of tiles is derived from seed and time
     const Creature *sel;
 
-    std::mutex mutex;
-    std::condition_variable cond_cmd, cond_work;
-    uint32_t stage;  Command cmd;
+    struct SplitTask  // chunks of a heavy tile, taken by any worker waiting for its dependencies
+    {
+        const std::function<void(size_t)> *proc;
+        size_t count;
+        std::atomic<size_t> next, done;
+    };
+
+    struct GroupSync
+    {
+        std::atomic<uint64_t> progress;  // phase << 32 | tiles done in that phase
+        uint64_t children_count[4];  // ring of 4 steps
+        std::atomic<SplitTask *> split;
+        std::atomic<uint32_t> split_users;
+        char pad[cache_pad];
+    };
+
+    // step phases: 3 * step + 1 after execute_step(), + 2 after consolidate(), + 3 after process_detectors(),
+    // a tile has reached the phase of its group's progress if it's among the tiles done, else the previous one
+    std::unique_ptr<GroupSync[]> group_sync;
+    mutable std::atomic<uint32_t> split_count;  // published tasks
+
+    uint32_t group_count;
+    mutable const std::function<void(size_t)> *task;
+    mutable size_t task_count;
+    mutable std::atomic<size_t> task_next;
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable cond_cmd, cond_work;
+    mutable uint32_t stage, step_n;  mutable Command cmd;
+
+    explicit Context(uint32_t group_count) : group_count(group_count)
+    {
+    }
+
+    void alloc_phases();
+    void wait_phase(const std::atomic<uint64_t> &progress, uint64_t target) const;
+    void wait_neighbors(uint32_t index, uint32_t phase) const;
+    void wait_group(uint32_t index, uint32_t phase) const;
+    void run_split(uint32_t index, size_t count, const std::function<void(size_t)> &proc) const;
+    bool help_split() const;
 
     void start();
-    void pre_execute();
-    void post_execute(Command new_cmd);
+    void pre_execute() const;
+    void post_execute(Command new_cmd) const;
     void execute(Command new_cmd);
 
+    void run_tasks() const;
     Command first_wait(uint32_t &target);
-    void barrier(uint32_t &target);
     Command end_step(uint32_t &target);
     Command end_draw(uint32_t &target, const Creature *cr);
+    Command end_task(uint32_t &target);
 };
 
 
@@ -593,26 +802,37 @@ struct World : public Context
     typedef TileGroup::Tile Tile;
 
 
-    uint32_t group_count;
     std::vector<std::thread> threads;
 
 
     World(uint32_t group_count);
     ~World();
 
-    void init();
+    void init(uint8_t order_x = 6, uint8_t order_y = 6, bool populate = true);  // empty world if !populate
     void build_layout();
 
     void start();
     void next_step();
+    void run_steps(uint32_t n);
     void stop();
+    void relayout(uint32_t n, TileLayout::Ordering ordering);
+    void set_worker_count(uint32_t n);
+    void set_ordering(TileLayout::Ordering ordering);
+    void parallel_for(size_t count, const std::function<void(size_t)> &proc) const;
 
     void count_objects();
     const Creature *update(FoodData *food_buf, CreatureData *creature_buf, SectorData *attack_buf, uint64_t sel_id);
     const Creature *hit_test(const Position &pos, uint32_t rad, uint64_t prev_id) const;
 
+    void finish_load(uint64_t next_id);
+    bool load_chunks(FileQueue &queue, const ChunkEntry *entries, size_t chunk_count, uint64_t next_id);
     bool load(InStream &stream);
+    static bool chunked(const ChunkFile &file);
+    bool load(const ChunkFile &file, unsigned depth = 64);  // depth: requests in flight, 0 for plain reads
+    bool save_chunks(const std::function<bool(uint64_t, const std::vector<char> *, size_t)> &write, void *root) const;
     void save(OutStream &stream) const;
+    bool save(const ChunkFile &file, void *root, unsigned depth = 64) const;
+    void checksum(void *root) const;  // root hash save() would give
 
     size_t food_total() const
     {
@@ -631,6 +851,6 @@ struct World : public Context
 
     const Tile &get_tile(uint32_t index) const
     {
-        return groups[layout[index].group].tiles[layout[index].index];
+        return groups[layout.group(index)].get_tile(index);
     }
 };
@@ -0,0 +1,220 @@
+// network_bench.cpp : network evaluation modes timed on finalized genomes
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "world.h"
+#include "stream.h"
+
+
+
+struct Sample
+{
+    Network net;
+    std::vector<uint8_t> input;
+};
+
+struct Bench
+{
+    std::vector<Sample> samples;
+    std::vector<std::vector<uint8_t>> input;
+    std::vector<Network::State> state;
+    uint32_t round_count;
+
+
+    void reset()
+    {
+        input.resize(samples.size());  state.assign(samples.size(), Network::State());
+        for(size_t i = 0; i < samples.size(); i++)input[i] = samples[i].input;
+    }
+
+    void perturb(Random &rand)
+    {
+        // a creature sees mostly the same picture from step to step: change about 1/8 of sensors
+
+        for(size_t i = 0; i < samples.size(); i++)
+            for(uint32_t k = samples[i].net.neiron_count; k < samples[i].net.input_count; k++)
+            {
+                uint32_t val = rand.uint32();  if(!(val & 7))input[i][k] = uint8_t(val >> 8);
+            }
+    }
+
+    template<typename Proc> void run(const char *name, Proc proc)
+    {
+        // ns per evaluation with the cost of perturb() excluded, result is hashed to cross-check modes
+
+        reset();  Random rand(1, 2);
+        auto t0 = std::chrono::steady_clock::now();
+        for(uint32_t n = 0; n < round_count; n++)perturb(rand);
+        auto t1 = std::chrono::steady_clock::now();
+
+        reset();  rand = Random(1, 2);
+        auto t2 = std::chrono::steady_clock::now();
+        for(uint32_t n = 0; n < round_count; n++)
+        {
+            perturb(rand);  proc();
+        }
+        auto t3 = std::chrono::steady_clock::now();
+
+        uint64_t hash = 0;
+        for(size_t i = 0; i < samples.size(); i++)
+            for(uint32_t k = 0; k < samples[i].net.neiron_count; k++)hash = (hash ^ input[i][k]) * 0x100000001B3;
+
+        double time = std::chrono::duration<double, std::nano>((t3 - t2) - (t1 - t0)).count();
+        time /= double(round_count) * samples.size();
+        std::printf("%-20s %8.1f ns/eval  result %016llX\n", name, time, static_cast<unsigned long long>(hash));
+    }
+};
+
+
+Genome make_genome(const Config &config, Random &rand, uint32_t link_factor)
+{
+    // one core gene per slot (or none for a pure link neiron) and a geometric number of links,
+    // GenomeProcessor then prunes it the same way as an evolved genome
+
+    const Slot::Type types[] =
+    {
+        Slot::link, Slot::link, Slot::link, Slot::stomach, Slot::womb, Slot::eye,
+        Slot::radar, Slot::claw, Slot::hide, Slot::leg, Slot::rotator, Slot::signal
+    };
+
+    uint32_t slot_count = uint32_t(1) << config.slot_bits;
+    Genome genome(config);  genome.genes.clear();
+    for(uint32_t slot = 0; slot < slot_count; slot++)
+    {
+        Slot::Type type = slot ? types[rand.uniform(sizeof(types))] : Slot::mouth;
+        if(type != Slot::link)genome.genes.emplace_back(config, slot, type,
+            rand.uniform(256), rand.uint32(), rand.uint32(), 1 + rand.uniform(255), uint8_t(rand.uint32()));
+        for(uint32_t n = rand.geometric(link_factor); n; n--)
+        {
+            int32_t weight = int32_t(rand.uniform(255)) - 127;
+            genome.genes.emplace_back(config, slot, weight ? weight : 1, rand.uniform(slot_count), uint8_t(rand.uint32()));
+        }
+    }
+    std::fill(genome.chromosomes.begin(), genome.chromosomes.end(), 0);
+    genome.chromosomes[0] = genome.genes.size();  return genome;
+}
+
+void add_creature(Bench &bench, const Creature &cr)
+{
+    bench.samples.push_back(Sample{cr.net, cr.input});
+}
+
+bool load_samples(Bench &bench, const char *path)
+{
+    World world(1);  world.start();  ChunkFile file;
+    if(!file.open(path))
+    {
+        std::printf("Cannot open restart file \"%s\"!\n", path);  return false;
+    }
+    bool res = World::chunked(file) && world.load(file);  file.close();
+    if(!res)
+    {
+        std::printf("Invalid restart file \"%s\"!\n", path);  return false;
+    }
+    for(uint32_t i = 0; i < world.layout.size(); i++)
+        for(const Creature *cr = world.get_tile(i).first; cr; cr = cr->next)add_creature(bench, *cr);
+    return true;
+}
+
+void make_samples(Bench &bench, uint32_t genome_count)
+{
+    // clones share a network like offspring without mutations do, link density varies from 1 to 15 per slot
+
+    World world(1);  world.init(6, 6, false);
+    const uint32_t link_factor[] = {0x80000000, 0xC0000000, 0xE0000000, 0xF0000000};
+
+    Random rand(3, 4);
+    for(uint32_t i = 0; i < genome_count; i++)
+    {
+        Genome genome = make_genome(world.config, rand, link_factor[i % 4]);
+        Creature *cr = Creature::spawn(world.config, genome, i, Position{0, 0}, 0, uint64_t(-1));
+        if(!cr)continue;
+
+        for(uint32_t k = cr->net.neiron_count; k < cr->net.input_count; k++)cr->input[k] = rand.uint32();
+        for(uint32_t n = 1 + rand.uniform(2 * Network::batch_size); n; n--)add_creature(bench, *cr);
+        delete cr;
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    // usage: network_bench [rounds [restart file]], without file networks come from generated genomes
+
+    Bench bench;  bench.round_count = argc > 1 ? std::atoi(argv[1]) : 100;
+    if(argc > 2)
+    {
+        if(!load_samples(bench, argv[2]))return 1;
+    }
+    else make_samples(bench, 1024);
+    if(bench.samples.empty())
+    {
+        std::printf("No creatures!\n");  return 1;
+    }
+
+    // identical networks next to each other, that's what batching relies on
+
+    std::stable_sort(bench.samples.begin(), bench.samples.end(),
+        [](const Sample &a, const Sample &b) { return a.net.identity < b.net.identity; });
+    std::vector<size_t> runs(1, 0);
+    uint64_t link_count = 0, neiron_count = 0;
+    for(size_t i = 0; i < bench.samples.size(); i++)
+    {
+        link_count += bench.samples[i].net.fanout.size();
+        neiron_count += bench.samples[i].net.neiron_count;
+        if(i && !(bench.samples[i].net == bench.samples[runs.back()].net))runs.push_back(i);
+    }
+    runs.push_back(bench.samples.size());
+
+    std::printf("%zu creatures, %zu distinct networks, %.1f neirons and %.1f links per network\n",
+        bench.samples.size(), runs.size() - 1, double(neiron_count) / bench.samples.size(),
+        double(link_count) / bench.samples.size());
+
+    const char *kernel_names[] = {"full scalar", "full sse41", "full avx2"};
+    const char *batch_names[] = {"batched scalar", "batched sse41", "batched avx2"};
+    for(auto kernel : {Network::k_scalar, Network::k_sse41, Network::k_avx2})
+    {
+        if(!Network::select_kernel(kernel))
+        {
+            std::printf("%-20s not supported, skipped\n", kernel_names[kernel]);  continue;
+        }
+        bench.run(kernel_names[kernel], [&bench]()
+            {
+                for(size_t i = 0; i < bench.samples.size(); i++)
+                    bench.samples[i].net.execute_full(bench.state[i], bench.input[i].data());
+            });
+        if(kernel == Network::k_sse41)continue;  // batches have no SSE4.1 variant
+
+        bench.run(batch_names[kernel], [&bench, &runs]()
+            {
+                uint8_t *batch[Network::batch_size];
+                for(size_t r = 0; r + 1 < runs.size(); r++)
+                    for(size_t i = runs[r]; i < runs[r + 1]; i += Network::batch_size)
+                    {
+                        uint32_t count = std::min<size_t>(Network::batch_size, runs[r + 1] - i);
+                        for(uint32_t k = 0; k < count; k++)batch[k] = bench.input[i + k].data();
+                        bench.samples[i].net.execute_batch(batch, count);
+                    }
+            });
+    }
+    Network::select_kernel(Network::best_kernel());
+
+    const char *mode_names[] = {"mode full", "mode incremental", "mode jit"};
+    for(auto mode : {Network::m_full, Network::m_incremental, Network::m_jit})
+    {
+        if(!Network::select_mode(mode))
+        {
+            std::printf("%-20s not supported, skipped\n", mode_names[mode]);  continue;
+        }
+        bench.run(mode_names[mode], [&bench]()
+            {
+                for(size_t i = 0; i < bench.samples.size(); i++)
+                    bench.samples[i].net.execute(bench.state[i], bench.input[i].data());
+            });
+    }
+    Network::select_mode(Network::m_full);  return 0;
+}
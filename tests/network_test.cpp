@@ -0,0 +1,201 @@
+// network_test.cpp : network kernels against a plain reference
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "network.h"
+
+
+
+struct TestNet
+{
+    std::vector<int32_t> levels;
+    uint32_t input_count;
+    std::vector<Network::Link> links;
+    Network net;
+};
+
+void make_net(TestNet &test, std::mt19937 &rand)
+{
+    // sensor link counts per output are random, so slices get both odd and even column counts,
+    // neiron counts go up to the limit, where there's no room left for sensors
+
+    uint32_t neiron_count = 1 + rand() % Network::max_neirons;
+    uint32_t sensor_count = std::min<uint32_t>(1 + rand() % 32, Network::max_neirons - neiron_count);
+    test.input_count = neiron_count + sensor_count;
+    test.levels.resize(neiron_count);
+    for(auto &level : test.levels)level = int32_t(rand() % 4001) - 2000;
+
+    test.links.clear();
+    for(uint32_t i = 0; i < neiron_count; i++)
+    {
+        uint32_t n_bin = rand() % 6, n_gen = sensor_count ? rand() % 8 : 0;
+        for(uint32_t k = 0; k < n_bin; k++)
+            test.links.emplace_back(rand() % neiron_count, i, int8_t(rand()));
+        for(uint32_t k = 0; k < n_gen; k++)
+            test.links.emplace_back(neiron_count + rand() % sensor_count, i, int8_t(rand()));
+    }
+    std::shuffle(test.links.begin(), test.links.end(), rand);
+    test.net.build(test.levels, test.input_count, test.links);
+}
+
+bool odd_columns(const Network &net)
+{
+    for(uint32_t s = 0; 2 * s + 1 < net.parts.size(); s++)
+        if((net.parts[2 * s + 1] - net.parts[2 * s]) / Network::slice_size % 2)return true;
+    return false;
+}
+
+void make_input(const TestNet &test, std::vector<uint8_t> &input, std::mt19937 &rand)
+{
+    input.resize(test.input_count);
+    for(uint32_t i = 0; i < test.input_count; i++)
+        input[i] = i < test.levels.size() ? (rand() & 1 ? 255 : 0) : uint8_t(rand());
+}
+
+void reference(const TestNet &test, uint8_t *input)
+{
+    std::vector<int32_t> level(test.levels.size(), 0);
+    for(const auto &link : test.links)level[link.output] += link.weight * int32_t(input[link.input]);
+    for(size_t i = 0; i < level.size(); i++)input[i] = level[i] > test.levels[i] ? 255 : 0;
+}
+
+
+bool check_kernels(const std::vector<TestNet> &tests)
+{
+    const char *names[] = {"scalar", "sse41", "avx2"};
+
+    bool res = true;
+    for(auto kernel : {Network::k_scalar, Network::k_sse41, Network::k_avx2})
+    {
+        if(!Network::select_kernel(kernel))
+        {
+            std::printf("kernel %-12s not supported, skipped\n", names[kernel]);  continue;
+        }
+
+        uint32_t errors = 0;
+        std::mt19937 rand(777);
+        std::vector<uint8_t> input, check;
+        for(const auto &test : tests)
+        {
+            make_input(test, input, rand);  check = input;
+            Network::State state;  test.net.execute_full(state, input.data());
+            reference(test, check.data());
+            if(!std::equal(check.begin(), check.begin() + test.levels.size(), input.begin()))errors++;
+        }
+        std::printf("kernel %-12s %u/%zu wrong\n", names[kernel], errors, tests.size());
+        if(errors)res = false;
+    }
+    Network::select_kernel(Network::best_kernel());  return res;
+}
+
+bool check_modes(const std::vector<TestNet> &tests)
+{
+    // several steps per network with neiron outputs fed back and few sensors changed,
+    // the last variant switches mode every step to exercise state invalidation
+
+    const char *names[] = {"full", "incremental", "jit", "mixed"};
+    const uint32_t step_count = 8;
+
+    bool res = true;
+    for(int mode = Network::m_full; mode <= Network::m_jit + 1; mode++)
+    {
+        if(mode <= Network::m_jit && !Network::select_mode(Network::Mode(mode)))
+        {
+            std::printf("mode   %-12s not supported, skipped\n", names[mode]);  continue;
+        }
+
+        uint32_t errors = 0;
+        std::mt19937 rand(555);
+        std::vector<uint8_t> input, check;
+        for(const auto &test : tests)
+        {
+            Network::State state;  make_input(test, input, rand);
+            for(uint32_t step = 0; step < step_count; step++)
+            {
+                if(mode > Network::m_jit)
+                    Network::select_mode(Network::Mode(rand() % (Network::m_jit + 1)));
+                for(uint32_t i = test.levels.size(); i < test.input_count; i++)
+                    if(!(rand() % 4))input[i] = uint8_t(rand());
+
+                check = input;  reference(test, check.data());
+                test.net.execute(state, input.data());
+                if(!std::equal(check.begin(), check.begin() + test.levels.size(), input.begin()))
+                {
+                    errors++;  break;
+                }
+            }
+        }
+        std::printf("mode   %-12s %u/%zu wrong\n", names[mode], errors, tests.size());
+        if(errors)res = false;
+    }
+    Network::select_mode(Network::m_full);  return res;
+}
+
+bool check_batches(const std::vector<TestNet> &tests)
+{
+    const char *names[] = {"scalar", "sse41", "avx2"};
+    const uint32_t max_count = 2 * Network::batch_size + 3;
+
+    bool res = true;
+    for(auto kernel : {Network::k_scalar, Network::k_avx2})
+    {
+        if(!Network::select_kernel(kernel))
+        {
+            std::printf("batch  %-12s not supported, skipped\n", names[kernel]);  continue;
+        }
+
+        uint32_t errors = 0;
+        std::mt19937 rand(333);
+        std::vector<std::vector<uint8_t>> input(max_count), check(max_count);
+        std::vector<uint8_t *> batch(max_count);
+        for(const auto &test : tests)
+        {
+            uint32_t count = 1 + rand() % max_count;
+            for(uint32_t k = 0; k < count; k++)
+            {
+                make_input(test, input[k], rand);  check[k] = input[k];
+                reference(test, check[k].data());  batch[k] = input[k].data();
+            }
+            test.net.execute_batch(batch.data(), count);
+            for(uint32_t k = 0; k < count; k++)
+                if(!std::equal(check[k].begin(), check[k].begin() + test.levels.size(), input[k].begin()))
+                {
+                    errors++;  break;
+                }
+        }
+        std::printf("batch  %-12s %u/%zu wrong\n", names[kernel], errors, tests.size());
+        if(errors)res = false;
+    }
+    Network::select_kernel(Network::best_kernel());  return res;
+}
+
+
+int main()
+{
+    const uint32_t net_count = 2000;
+
+    std::mt19937 rand(12345);
+    std::vector<TestNet> tests(net_count);
+    uint32_t odd = 0, full = 0;
+    for(auto &test : tests)
+    {
+        make_net(test, rand);  if(odd_columns(test.net))odd++;
+        if(test.levels.size() == Network::max_neirons)full++;
+    }
+    if(!odd)
+    {
+        std::printf("No networks with odd column count!\n");  return 1;
+    }
+    if(!full)
+    {
+        std::printf("No networks with maximal neiron count!\n");  return 1;
+    }
+
+    bool res = check_kernels(tests);
+    res = check_modes(tests) && res;
+    res = check_batches(tests) && res;
+    return res ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+// stream_test.cpp : file streams against a stream written by the original OutFileStream (Evol0004 framing)
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "stream.h"
+
+
+
+// data/evol0004_stream.bin: uint32_t values from 0 to value_count - 1, more than two 64 KiB frames,
+// each full frame followed by the hash state at its end, the last one by the checksum
+const uint32_t value_count = 33018;
+
+bool check_values(InStream &stream)
+{
+    for(uint32_t i = 0; i < value_count; i++)
+    {
+        uint32_t val;  stream >> val;
+        if(!stream || val != i)return false;
+    }
+    return stream.at_end();
+}
+
+bool read_file(const char *path, std::vector<char> &data)
+{
+    FILE *file = std::fopen(path, "rb");  if(!file)return false;
+    data.clear();  char buf[4096];
+    for(size_t n; (n = std::fread(buf, 1, sizeof(buf), file));)data.insert(data.end(), buf, buf + n);
+    bool res = !std::ferror(file);
+    return !std::fclose(file) && res;
+}
+
+int main(int argc, char **argv)
+{
+    const char *fixture = argc > 1 ? argv[1] : "data/evol0004_stream.bin";
+    const char *path = "stream_test.save";
+
+    InMapStream framed(true);
+    if(!framed.open(fixture))
+    {
+        std::printf("Cannot open \"%s\"!\n", fixture);  return 1;
+    }
+    bool res = check_values(framed);
+    if(!framed.close() || !res)
+    {
+        std::printf("Framed stream is not read back!\n");  return 1;
+    }
+
+    // same data written now: frames without hash states in between, the same final checksum
+
+    OutFileStream out;  res = out.open(path);
+    for(uint32_t i = 0; i < value_count; i++)out << i;
+    if(!out.close() || !res)
+    {
+        std::printf("Cannot write \"%s\"!\n", path);  return 1;
+    }
+
+    std::vector<char> old, written, expected;
+    if(!read_file(fixture, old) || !read_file(path, written))return 1;
+    size_t frame = InMapStream::frame_size, data_size = old.size() - Hash::result_size;
+    for(size_t offs = 0; offs < data_size; offs += frame + Hash::result_size)
+    {
+        size_t n = std::min(frame, data_size - offs);
+        expected.insert(expected.end(), old.begin() + offs, old.begin() + offs + n);
+    }
+    expected.insert(expected.end(), old.end() - Hash::result_size, old.end());
+    if(written != expected)
+    {
+        std::printf("Written stream differs from the framed one without hash states!\n");  return 1;
+    }
+
+    InFileStream in;  res = in.open(path) && check_values(in);
+    res = in.close() && res;
+    InMapStream map;  res = res && map.open(path) && check_values(map);
+    res = map.close() && res;
+    std::remove(path);
+    if(!res)
+    {
+        std::printf("Written stream is not read back!\n");  return 1;
+    }
+    return 0;
+}
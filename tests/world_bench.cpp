@@ -0,0 +1,110 @@
+// world_bench.cpp : step time with hardware counters, world_bench_nopad is the same without cache line padding
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "world.h"
+
+#ifdef __linux__
+#define BENCH_PERF
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+
+struct Counter
+{
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+};
+
+#ifdef BENCH_PERF
+#define CACHE_EVENT(cache, op, result) \
+    (PERF_COUNT_HW_CACHE_##cache | PERF_COUNT_HW_CACHE_OP_##op << 8 | PERF_COUNT_HW_CACHE_RESULT_##result << 16)
+
+Counter counters[] =
+{
+    {"cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+    {"instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+    {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, -1},
+    {"cache-misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1},
+    {"L1d-load-misses",  PERF_TYPE_HW_CACHE, CACHE_EVENT(L1D, READ, MISS), -1},
+    {"LLC-store-misses", PERF_TYPE_HW_CACHE, CACHE_EVENT(LL, WRITE, MISS), -1},
+    {"task-clock-ns",    PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, -1},
+    {"cpu-migrations",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, -1},
+};
+
+void open_counters()
+{
+    // inherited by threads started afterwards, their counts are added when they exit
+
+    for(auto &counter : counters)
+    {
+        perf_event_attr attr;  std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);  attr.type = counter.type;  attr.config = counter.config;
+        attr.inherit = 1;  attr.exclude_hv = 1;
+        attr.exclude_kernel = counter.type != PERF_TYPE_SOFTWARE;  // scheduler events are kernel side
+        counter.fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+void print_counters(uint32_t step_count)
+{
+    for(auto &counter : counters)
+    {
+        uint64_t val;
+        if(counter.fd < 0 || read(counter.fd, &val, sizeof(val)) != sizeof(val))
+        {
+            std::printf("%-18s %16s\n", counter.name, "n/a");  continue;
+        }
+        std::printf("%-18s %16llu %14.1f per step\n", counter.name,
+            static_cast<unsigned long long>(val), double(val) / step_count);
+        close(counter.fd);  counter.fd = -1;
+    }
+}
+#else
+void open_counters()
+{
+}
+
+void print_counters(uint32_t)
+{
+    std::printf("No performance counters on this platform.\n");
+}
+#endif
+
+
+int main(int argc, char **argv)
+{
+    // usage: world_bench [groups [steps [warmup]]], default is a group per hardware thread
+
+    uint32_t group_count = std::max(2u, std::thread::hardware_concurrency());
+    if(argc > 1)group_count = std::atoi(argv[1]);
+    uint32_t step_count = argc > 2 ? std::atoi(argv[2]) : 200;
+    uint32_t warmup = argc > 3 ? std::atoi(argv[3]) : 100;
+
+    World world(group_count);  world.start();  world.init();
+    world.run_steps(warmup);  world.stop();
+
+    // workers are restarted so that every one of them is counted
+
+    open_counters();
+    auto t0 = std::chrono::steady_clock::now();
+    world.start();  world.run_steps(step_count);  world.stop();
+    auto t1 = std::chrono::steady_clock::now();
+
+    world.count_objects();
+    std::printf("%s, %u groups, %u steps after %u: %.3f ms per step, %zu foods, %zu creatures\n",
+        cache_pad == cache_line ? "padded" : "unpadded", group_count, step_count, warmup,
+        std::chrono::duration<double, std::milli>(t1 - t0).count() / step_count,
+        world.food_total(), world.creature_total());
+    print_counters(step_count);  return 0;
+}
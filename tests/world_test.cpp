@@ -0,0 +1,148 @@
+// world_test.cpp : sparse world of 2^29 tiles, determinism, queued file I/O and restart round trip
+//
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "world.h"
+#include "stream.h"
+#include "hash.h"
+
+
+
+struct Root
+{
+    char data[Hash::result_size];
+
+    bool operator == (const Root &cmp) const
+    {
+        return !std::memcmp(data, cmp.data, sizeof(data));
+    }
+};
+
+Root checksum(const World &world)
+{
+    Root root;  world.checksum(root.data);  return root;
+}
+
+bool check_config_limit()
+{
+    World world(1);  world.init();
+    Config config = world.config;
+    config.order_x = config.order_y = 15;
+    if(!config.calc_derived())return false;
+    config.order_y++;  return !config.calc_derived();
+}
+
+void init_sparse(World &world, TileLayout::Ordering ordering)
+{
+    // empty world: only rare random sprouts appear, tile pages are allocated around them alone
+
+    world.start();  world.init(14, 15, false);  world.set_ordering(ordering);
+    world.config.exp_sprout_per_tile = ~(uint32_t(-1) >> 24);  // about 2^-24 per tile, few dozens per step
+}
+
+Root run_sparse(uint32_t group_count, TileLayout::Ordering ordering, uint32_t steps)
+{
+    World world(group_count);  init_sparse(world, ordering);
+    for(uint32_t i = 0; i < steps; i++)world.next_step();
+    return checksum(world);
+}
+
+bool check_queue(const char *path, unsigned depth)
+{
+    // more requests than depth, of uneven sizes, and a read past the end that must fail
+
+    std::vector<char> data(1 << 20), copy(data.size());
+    for(size_t i = 0; i < data.size(); i++)data[i] = char(i * 7 + i / 4093);
+
+    ChunkFile file;  if(!file.create(path))return false;
+    bool res = true;
+    {
+        FileQueue queue(file, depth);
+        if(depth && !queue.is_ring())std::printf("No io_uring, depth %u is done in place.\n", depth);
+        for(size_t offs = 0, size = 1; offs < data.size(); offs += size, size = size * 3 + 1)
+        {
+            size = std::min(size, data.size() - offs);
+            res = res && queue.write(offs, data.data() + offs, size);
+        }
+        res = queue.wait() && res;
+    }
+    res = file.close() && res;
+    if(!res || !file.open(path))return false;
+    {
+        FileQueue queue(file, depth);
+        for(size_t offs = data.size(), size = 1; offs; size = size * 5 + 3)
+        {
+            size = std::min(size, offs);  offs -= size;
+            res = res && queue.read(offs, copy.data() + offs, size);
+        }
+        res = queue.wait() && res && copy == data;
+        bool past = queue.read(data.size() - 16, copy.data(), 32);  // fails on submission or on wait
+        res = res && !(queue.wait() && past);
+    }
+    res = file.close() && res;
+    std::remove(path);  return res;
+}
+
+bool check_restart(const World &world, World &loaded, const char *path, unsigned save_depth, unsigned load_depth)
+{
+    ChunkFile file;  Root root;
+    bool res = file.create(path) && world.save(file, root.data, save_depth);
+    if(file.is_open())res = file.close() && res;
+    if(!res)
+    {
+        std::printf("Cannot save \"%s\"!\n", path);  return false;
+    }
+    res = file.open(path) && World::chunked(file) && loaded.load(file, load_depth);
+    if(file.is_open())res = file.close() && res;
+    std::remove(path);
+    if(!res || !(checksum(loaded) == root))
+    {
+        std::printf("Restart round trip failed (depth %u, %u)!\n", save_depth, load_depth);  return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const uint32_t steps = 16;
+    const char *path = "world_test.save";
+
+    if(!check_config_limit())
+    {
+        std::printf("Config size limit is not enforced!\n");  return 1;
+    }
+
+    World world(4);  init_sparse(world, TileLayout::l_rows);
+    world.run_steps(steps);  world.count_objects();
+    std::printf("%ux%u tiles, %u steps: %zu foods\n",
+        1u << world.config.order_x, 1u << world.config.order_y, steps, world.food_total());
+    if(!world.food_total())
+    {
+        std::printf("No sprouts!\n");  return 1;
+    }
+
+    // Morton order has border pages inside the world and buffers of outer tiles
+    if(!(checksum(world) == run_sparse(7, TileLayout::l_rows, steps)) ||
+        !(run_sparse(3, TileLayout::l_morton, steps) == run_sparse(6, TileLayout::l_morton, steps)))
+    {
+        std::printf("Result depends on group count!\n");  return 1;
+    }
+
+    // ring and plain paths for queued reads and writes
+
+    for(unsigned depth : {0u, 4u, 64u})if(!check_queue(path, depth))
+    {
+        std::printf("File queue round trip failed (depth %u)!\n", depth);  return 1;
+    }
+    World loaded(3), plain(2);  loaded.start();  plain.start();
+    if(!check_restart(world, loaded, path, 64, 0) || !check_restart(world, plain, path, 0, 64))return 1;
+
+    world.run_steps(steps);  loaded.run_steps(steps);  plain.run_steps(steps);
+    if(!(checksum(world) == checksum(loaded)) || !(checksum(world) == checksum(plain)))
+    {
+        std::printf("Loaded world diverges!\n");  return 1;
+    }
+    return 0;
+}